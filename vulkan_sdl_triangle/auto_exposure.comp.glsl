@@ -0,0 +1,55 @@
+#version 450
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+#define HISTOGRAM_BINS 256
+
+layout(local_size_x = HISTOGRAM_BINS) in;
+
+layout(binding = 3) readonly buffer Histogram {
+    uint bins[HISTOGRAM_BINS];
+} histogram;
+
+layout(binding = 4) buffer Exposure {
+    float averageLuminance;
+    float exposure;
+} result;
+
+layout(push_constant) uniform PushConstants {
+    float minLogLuminance;
+    float logLuminanceRange;
+    float pixelCount;
+    float adaptationRate;
+} pc;
+
+shared float sharedPartials[HISTOGRAM_BINS];
+
+void main() {
+    uint bin = gl_LocalInvocationIndex;
+    float count = float(histogram.bins[bin]);
+
+    // weight every bin by its index, reduce within the subgroup first and only
+    // go through shared memory for the per-subgroup partial sums
+    float weighted = subgroupAdd(count * float(bin));
+    if (subgroupElect()) {
+        sharedPartials[gl_SubgroupID] = weighted;
+    }
+    barrier();
+
+    if (bin == 0) {
+        float weightedSum = 0.0;
+        for (uint i = 0; i < gl_NumSubgroups; ++i) {
+            weightedSum += sharedPartials[i];
+        }
+
+        // bin 0 holds the black pixels, they must not drag the average down
+        float litPixels = max(pc.pixelCount - count, 1.0);
+        float averageBin = weightedSum / litPixels - 1.0;
+        float averageLogLuminance = averageBin / 254.0 * pc.logLuminanceRange + pc.minLogLuminance;
+        float targetLuminance = exp2(averageLogLuminance);
+
+        float adapted = result.averageLuminance + (targetLuminance - result.averageLuminance) * pc.adaptationRate;
+        result.averageLuminance = adapted;
+        result.exposure = 0.18 / max(adapted, 0.0001);
+    }
+}
@@ -0,0 +1,57 @@
+#version 450
+
+#define GROUP_SIZE 16
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+layout(binding = 1, rgba16f) uniform writeonly image2D dstImage;
+layout(binding = 2) uniform sampler2D srcTexture;
+
+layout(push_constant) uniform PushConstants {
+    vec2 srcTexelSize;
+    float threshold;
+    uint applyThreshold;
+} pc;
+
+// 13 tap downsample (Jimenez, "Next Generation Post Processing in Call of Duty: Advanced Warfare")
+vec3 downsample(vec2 uv) {
+    vec2 t = pc.srcTexelSize;
+    vec3 a = textureLod(srcTexture, uv + t * vec2(-2.0, -2.0), 0.0).rgb;
+    vec3 b = textureLod(srcTexture, uv + t * vec2( 0.0, -2.0), 0.0).rgb;
+    vec3 c = textureLod(srcTexture, uv + t * vec2( 2.0, -2.0), 0.0).rgb;
+    vec3 d = textureLod(srcTexture, uv + t * vec2(-2.0,  0.0), 0.0).rgb;
+    vec3 e = textureLod(srcTexture, uv, 0.0).rgb;
+    vec3 f = textureLod(srcTexture, uv + t * vec2( 2.0,  0.0), 0.0).rgb;
+    vec3 g = textureLod(srcTexture, uv + t * vec2(-2.0,  2.0), 0.0).rgb;
+    vec3 h = textureLod(srcTexture, uv + t * vec2( 0.0,  2.0), 0.0).rgb;
+    vec3 i = textureLod(srcTexture, uv + t * vec2( 2.0,  2.0), 0.0).rgb;
+    vec3 j = textureLod(srcTexture, uv + t * vec2(-1.0, -1.0), 0.0).rgb;
+    vec3 k = textureLod(srcTexture, uv + t * vec2( 1.0, -1.0), 0.0).rgb;
+    vec3 l = textureLod(srcTexture, uv + t * vec2(-1.0,  1.0), 0.0).rgb;
+    vec3 m = textureLod(srcTexture, uv + t * vec2( 1.0,  1.0), 0.0).rgb;
+
+    vec3 color = e * 0.125;
+    color += (a + c + g + i) * 0.03125;
+    color += (b + d + f + h) * 0.0625;
+    color += (j + k + l + m) * 0.125;
+    return color;
+}
+
+void main() {
+    ivec2 size = imageSize(dstImage);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= size.x || pixel.y >= size.y) {
+        return;
+    }
+
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+    vec3 color = downsample(uv);
+
+    // the first pass only keeps what is bright enough to bloom
+    if (pc.applyThreshold != 0) {
+        float brightness = max(color.r, max(color.g, color.b));
+        color *= max(brightness - pc.threshold, 0.0) / max(brightness, 0.0001);
+    }
+
+    imageStore(dstImage, pixel, vec4(color, 1.0));
+}
@@ -0,0 +1,37 @@
+#version 450
+
+#define GROUP_SIZE 16
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+layout(binding = 1, rgba16f) uniform image2D dstImage;
+layout(binding = 2) uniform sampler2D srcTexture;
+
+layout(push_constant) uniform PushConstants {
+    vec2 srcTexelSize;
+    float filterRadius;
+} pc;
+
+void main() {
+    ivec2 size = imageSize(dstImage);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= size.x || pixel.y >= size.y) {
+        return;
+    }
+
+    // 3x3 tent filter over the lower mip, accumulated onto this one
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+    vec2 t = pc.srcTexelSize * pc.filterRadius;
+    vec3 color = textureLod(srcTexture, uv, 0.0).rgb * 4.0;
+    color += (textureLod(srcTexture, uv + vec2(-t.x, 0.0), 0.0).rgb +
+              textureLod(srcTexture, uv + vec2( t.x, 0.0), 0.0).rgb +
+              textureLod(srcTexture, uv + vec2(0.0, -t.y), 0.0).rgb +
+              textureLod(srcTexture, uv + vec2(0.0,  t.y), 0.0).rgb) * 2.0;
+    color += textureLod(srcTexture, uv + vec2(-t.x, -t.y), 0.0).rgb +
+             textureLod(srcTexture, uv + vec2( t.x, -t.y), 0.0).rgb +
+             textureLod(srcTexture, uv + vec2(-t.x,  t.y), 0.0).rgb +
+             textureLod(srcTexture, uv + vec2( t.x,  t.y), 0.0).rgb;
+    color *= 1.0 / 16.0;
+
+    imageStore(dstImage, pixel, vec4(imageLoad(dstImage, pixel).rgb + color, 1.0));
+}
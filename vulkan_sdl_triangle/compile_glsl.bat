@@ -1,3 +1,10 @@
 C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V triangle.vert.glsl -o triangle.vert
 C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V triangle.frag.glsl -o triangle.frag
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V mesh.vert.glsl -o mesh.vert
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V mesh.frag.glsl -o mesh.frag
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V --target-env vulkan1.1 luminance_histogram.comp.glsl -o luminance_histogram.comp
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V --target-env vulkan1.1 auto_exposure.comp.glsl -o auto_exposure.comp
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V --target-env vulkan1.1 bloom_downsample.comp.glsl -o bloom_downsample.comp
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V --target-env vulkan1.1 bloom_upsample.comp.glsl -o bloom_upsample.comp
+C:/VulkanSDK/1.1.77.0/Bin/glslangValidator.exe -V --target-env vulkan1.1 tonemap.comp.glsl -o tonemap.comp
 pause
\ No newline at end of file
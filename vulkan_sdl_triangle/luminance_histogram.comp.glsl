@@ -0,0 +1,62 @@
+#version 450
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_ballot : enable
+
+#define GROUP_SIZE 16
+#define HISTOGRAM_BINS 256
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+layout(binding = 0, rgba16f) uniform readonly image2D hdrImage;
+layout(binding = 3) buffer Histogram {
+    uint bins[HISTOGRAM_BINS];
+} histogram;
+
+layout(push_constant) uniform PushConstants {
+    float minLogLuminance;
+    float inverseLogLuminanceRange;
+} pc;
+
+shared uint sharedBins[HISTOGRAM_BINS];
+
+// bin 0 is reserved for (near) black pixels, the rest cover [minLogLuminance, minLogLuminance + range]
+uint luminanceToBin(vec3 color) {
+    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    if (luminance < 0.005) {
+        return 0;
+    }
+    float logLuminance = clamp((log2(luminance) - pc.minLogLuminance) * pc.inverseLogLuminanceRange, 0.0, 1.0);
+    return uint(logLuminance * 254.0 + 1.0);
+}
+
+void main() {
+    sharedBins[gl_LocalInvocationIndex] = 0;
+    barrier();
+
+    ivec2 size = imageSize(hdrImage);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    uint bin = HISTOGRAM_BINS;
+    if (pixel.x < size.x && pixel.y < size.y) {
+        bin = luminanceToBin(imageLoad(hdrImage, pixel).rgb);
+    }
+
+    // neighbouring pixels mostly land in the same few bins: let one lane per distinct bin
+    // add the whole subgroup's count instead of every lane hitting the same shared counter
+    for (;;) {
+        uint leaderBin = subgroupBroadcastFirst(bin);
+        if (bin == leaderBin) {
+            uint count = subgroupBallotBitCount(subgroupBallot(true));
+            if (subgroupElect() && bin < HISTOGRAM_BINS) {
+                atomicAdd(sharedBins[bin], count);
+            }
+            break;
+        }
+    }
+    barrier();
+
+    // one global atomic per bin per workgroup
+    uint groupCount = sharedBins[gl_LocalInvocationIndex];
+    if (groupCount != 0) {
+        atomicAdd(histogram.bins[gl_LocalInvocationIndex], groupCount);
+    }
+}
@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec3 lightDirection = normalize(vec3(0.4, 1.0, 0.3));
+    float diffuse = max(dot(normalize(fragNormal), lightDirection), 0.0);
+    outColor = vec4(vec3(0.8) * (0.1 + diffuse), 1.0);
+}
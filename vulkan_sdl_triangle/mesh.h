@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// .mesh files, written offline by buildMeshFile and loaded by the renderer: a MeshFileHeader followed by the
+// tightly packed LODs, vertices, indices, meshlets, meshlet vertices and meshlet indices
+const uint32_t gMeshletMaxVertices = 64;
+const uint32_t gMeshletMaxTriangles = 124;
+
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+// index and meshlet ranges are relative to the mesh, indices to the LOD's first vertex
+struct MeshLod
+{
+	uint32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	float error; // object space distance the LOD may deviate from the full mesh
+};
+
+// a meshlet's triangles index the LOD's index buffer and, through the meshlet indices at the same positions, its own
+// vertex list: meshletIndices hold positions in meshletVertices[vertexOffset, vertexOffset + vertexCount), which hold
+// vertices relative to the LOD's first vertex, the layout mesh shaders consume.
+// a cluster is back facing when dot(center - camera, coneAxis) >= coneCutoff * length(center - camera) + radius
+struct Meshlet
+{
+	uint32_t indexOffset; // relative to the LOD's first index
+	uint32_t triangleCount;
+	uint32_t vertexOffset; // relative to the mesh
+	uint32_t vertexCount;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t lodCount;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t meshletCount;
+	uint32_t meshletVertexCount;
+	glm::vec3 center;
+	float radius;
+};
+
+struct MeshData
+{
+	glm::vec3 center;
+	float radius;
+	std::vector<MeshLod> lods;
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint8_t> meshletIndices; // one per index
+};
+
+// --build-mesh: turns an OBJ into a .mesh file, a LOD chain simplified by vertex clustering, each LOD
+// reordered for the post-transform cache and split into meshlets with bounding spheres and normal cones
+void buildMeshFile(const std::string& objFilename, const std::string& meshFilename);
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec3 fragNormal;
+
+layout(binding = 0) readonly buffer Objects {
+    mat4 viewProjection;
+    mat4 models[];
+} objects;
+
+layout(push_constant) uniform PushConstants {
+    uint objectIndex;
+} pc;
+
+void main() {
+    mat4 model = objects.models[pc.objectIndex];
+    gl_Position = objects.viewProjection * model * vec4(inPosition, 1.0);
+    fragNormal = mat3(model) * inNormal;
+}
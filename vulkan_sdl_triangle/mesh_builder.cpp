@@ -0,0 +1,540 @@
+#include "mesh.h"
+
+#include <set>
+#include <array>
+#include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+const uint32_t gMaxMeshLods = 8;
+const uint32_t gMinLodTriangles = 64;
+const uint32_t gVertexCacheSize = 16;
+
+static void loadObj(const std::string& filename, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+	std::ifstream file(filename);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open file!");
+	}
+
+	// positions and faces only, polygons are triangulated as fans
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string type;
+		stream >> type;
+
+		if (type == "v")
+		{
+			glm::vec3 position;
+			if (!(stream >> position.x >> position.y >> position.z))
+			{
+				throw std::runtime_error("OBJ file has a malformed vertex: " + line);
+			}
+			positions.push_back(position);
+		}
+		else if (type == "f")
+		{
+			std::vector<uint32_t> face;
+			std::string vertex;
+			while (stream >> vertex)
+			{
+				// v, v/vt, v//vn or v/vt/vn, only the position index is used. negative indices count back from the last vertex
+				char* end = nullptr;
+				errno = 0;
+				long long index = std::strtoll(vertex.c_str(), &end, 10);
+				if (end == vertex.c_str() || (*end != '\0' && *end != '/') || errno == ERANGE || index == 0 ||
+					index < -(long long)positions.size() || index > (long long)std::numeric_limits<uint32_t>::max())
+				{
+					throw std::runtime_error("OBJ face has a malformed vertex index: " + vertex);
+				}
+				face.push_back(index < 0 ? (uint32_t)((long long)positions.size() + index) : (uint32_t)(index - 1));
+			}
+
+			for (size_t i = 2; i < face.size(); ++i)
+			{
+				indices.push_back(face[0]);
+				indices.push_back(face[i - 1]);
+				indices.push_back(face[i]);
+			}
+		}
+	}
+
+	if (indices.empty())
+	{
+		throw std::runtime_error("OBJ file has no faces!");
+	}
+
+	for (uint32_t index : indices)
+	{
+		if (index >= positions.size())
+		{
+			throw std::runtime_error("OBJ face references a missing vertex!");
+		}
+	}
+}
+
+// merge all vertices that fall into the same grid cell, dropping the triangles that collapse
+static void simplifyMesh(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, float cellSize,
+						 std::vector<glm::vec3>& outPositions, std::vector<uint32_t>& outIndices)
+{
+	glm::vec3 minimum = positions[0];
+	for (const auto& position : positions)
+	{
+		minimum = glm::min(minimum, position);
+	}
+
+	std::unordered_map<uint64_t, uint32_t> cells;
+	std::vector<glm::vec3> sums;
+	std::vector<uint32_t> counts;
+	std::vector<uint32_t> remap(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		glm::uvec3 cell = glm::uvec3((positions[i] - minimum) / cellSize);
+		uint64_t key = (uint64_t)cell.x | ((uint64_t)cell.y << 21) | ((uint64_t)cell.z << 42);
+
+		auto inserted = cells.emplace(key, (uint32_t)sums.size());
+		if (inserted.second)
+		{
+			sums.push_back(glm::vec3(0.0f));
+			counts.push_back(0);
+		}
+
+		remap[i] = inserted.first->second;
+		sums[remap[i]] += positions[i];
+		++counts[remap[i]];
+	}
+
+	outPositions.resize(sums.size());
+	for (size_t i = 0; i < sums.size(); ++i)
+	{
+		outPositions[i] = sums[i] / (float)counts[i];
+	}
+
+	// rotate each triangle so its smallest index comes first, that keeps the winding and makes duplicates compare equal
+	std::set<std::array<uint32_t, 3>> emitted;
+	outIndices.clear();
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t a = remap[indices[i]];
+		uint32_t b = remap[indices[i + 1]];
+		uint32_t c = remap[indices[i + 2]];
+		if (a == b || b == c || a == c)
+		{
+			continue;
+		}
+
+		std::array<uint32_t, 3> triangle = { a, b, c };
+		if (b < a && b < c)
+		{
+			triangle = { b, c, a };
+		}
+		else if (c < a && c < b)
+		{
+			triangle = { c, a, b };
+		}
+
+		if (emitted.insert(triangle).second)
+		{
+			outIndices.insert(outIndices.end(), triangle.begin(), triangle.end());
+		}
+	}
+}
+
+// average cache miss ratio of a FIFO post-transform cache, vertices shaded per triangle
+static float computeAcmr(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = gVertexCacheSize + 1;
+	uint32_t misses = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (time - cacheTime[index] > gVertexCacheSize)
+		{
+			cacheTime[index] = time++;
+			++misses;
+		}
+	}
+
+	return indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+static std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	const int cacheSize = (int)gVertexCacheSize;
+	uint32_t triangleCount = (uint32_t)indices.size() / 3;
+
+	// vertex to triangle adjacency
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		++liveTriangles[index];
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < indices.size(); ++i)
+	{
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	int time = cacheSize + 1;
+	uint32_t cursor = 0;
+	int fanning = vertexCount > 0 ? 0 : -1;
+
+	while (fanning >= 0)
+	{
+		// emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; ++i)
+		{
+			uint32_t triangle = adjacency[i];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t vertex = indices[triangle * 3 + k];
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				--liveTriangles[vertex];
+				if (time - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = time++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// continue from the candidate that has been in the cache longest and still fits its remaining triangles
+		fanning = -1;
+		int bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+
+			int priority = 0;
+			if (time - cacheTime[vertex] + 2 * (int)liveTriangles[vertex] <= cacheSize)
+			{
+				priority = time - cacheTime[vertex];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = (int)vertex;
+			}
+		}
+
+		// dead end, back track through recently emitted vertices, then scan for anything left
+		while (fanning < 0 && !deadEnd.empty())
+		{
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[vertex] > 0)
+			{
+				fanning = (int)vertex;
+			}
+		}
+
+		while (fanning < 0 && cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0)
+			{
+				fanning = (int)cursor;
+			}
+			++cursor;
+		}
+	}
+
+	return result;
+}
+
+// renumber vertices in the order the indices first use them, which also drops unreferenced ones
+static void optimizeVertexFetch(std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(positions.size(), std::numeric_limits<uint32_t>::max());
+	std::vector<glm::vec3> reordered;
+
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == std::numeric_limits<uint32_t>::max())
+		{
+			remap[index] = (uint32_t)reordered.size();
+			reordered.push_back(positions[index]);
+		}
+		index = remap[index];
+	}
+
+	positions.swap(reordered);
+}
+
+static std::vector<MeshVertex> computeVertexNormals(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+	std::vector<MeshVertex> vertices(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		vertices[i].position = positions[i];
+		vertices[i].normal = glm::vec3(0.0f);
+	}
+
+	// area weighted
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		glm::vec3 a = positions[indices[i]];
+		glm::vec3 b = positions[indices[i + 1]];
+		glm::vec3 c = positions[indices[i + 2]];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		vertices[indices[i]].normal += normal;
+		vertices[indices[i + 1]].normal += normal;
+		vertices[indices[i + 2]].normal += normal;
+	}
+
+	for (auto& vertex : vertices)
+	{
+		float length = glm::length(vertex.normal);
+		vertex.normal = length > 0.0f ? vertex.normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	return vertices;
+}
+
+// split the index stream greedily, in order, so the cache optimized order is kept inside each meshlet.
+// each meshlet's vertex list is appended to meshletVertices and every index gets its local index in meshletIndices
+static std::vector<Meshlet> buildMeshlets(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices,
+										  std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletIndices)
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> lastMeshlet(vertices.size(), std::numeric_limits<uint32_t>::max());
+	std::vector<uint8_t> localIndex(vertices.size());
+	uint32_t start = 0;
+	uint32_t vertexStart = (uint32_t)meshletVertices.size();
+
+	auto countNewVertices = [&](uint32_t i, uint32_t meshlet) -> uint32_t
+	{
+		uint32_t a = indices[i];
+		uint32_t b = indices[i + 1];
+		uint32_t c = indices[i + 2];
+		return (lastMeshlet[a] != meshlet ? 1 : 0) +
+			(lastMeshlet[b] != meshlet && b != a ? 1 : 0) +
+			(lastMeshlet[c] != meshlet && c != a && c != b ? 1 : 0);
+	};
+
+	auto finishMeshlet = [&](uint32_t end)
+	{
+		Meshlet meshlet;
+		meshlet.indexOffset = start;
+		meshlet.triangleCount = (end - start) / 3;
+		meshlet.vertexOffset = vertexStart;
+		meshlet.vertexCount = (uint32_t)meshletVertices.size() - vertexStart;
+
+		// bounding sphere around the box center
+		glm::vec3 minimum = vertices[indices[start]].position;
+		glm::vec3 maximum = minimum;
+		for (uint32_t i = start; i < end; ++i)
+		{
+			minimum = glm::min(minimum, vertices[indices[i]].position);
+			maximum = glm::max(maximum, vertices[indices[i]].position);
+		}
+		meshlet.center = (minimum + maximum) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (uint32_t i = start; i < end; ++i)
+		{
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.center));
+		}
+
+		// normal cone, the cutoff is the sine of its half angle, 1 when it is too wide to ever cull
+		std::vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = start; i < end; i += 3)
+		{
+			glm::vec3 a = vertices[indices[i]].position;
+			glm::vec3 normal = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				normals.push_back(normal / length);
+				axis += normals.back();
+			}
+		}
+
+		float axisLength = glm::length(axis);
+		meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+		float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+		for (const auto& normal : normals)
+		{
+			minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+		}
+		meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+
+		meshlets.push_back(meshlet);
+	};
+
+	for (uint32_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t meshlet = (uint32_t)meshlets.size();
+		uint32_t vertexCount = (uint32_t)meshletVertices.size() - vertexStart;
+		if (vertexCount + countNewVertices(i, meshlet) > gMeshletMaxVertices || (i - start) / 3 >= gMeshletMaxTriangles)
+		{
+			finishMeshlet(i);
+			start = i;
+			vertexStart = (uint32_t)meshletVertices.size();
+			meshlet = (uint32_t)meshlets.size();
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			uint32_t vertex = indices[i + k];
+			if (lastMeshlet[vertex] != meshlet)
+			{
+				lastMeshlet[vertex] = meshlet;
+				localIndex[vertex] = (uint8_t)(meshletVertices.size() - vertexStart);
+				meshletVertices.push_back(vertex);
+			}
+			meshletIndices.push_back(localIndex[vertex]);
+		}
+	}
+
+	if (start < indices.size())
+	{
+		finishMeshlet((uint32_t)indices.size());
+	}
+
+	return meshlets;
+}
+
+void buildMeshFile(const std::string& objFilename, const std::string& meshFilename)
+{
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	loadObj(objFilename, positions, indices);
+
+	MeshData mesh;
+	glm::vec3 minimum = positions[0];
+	glm::vec3 maximum = positions[0];
+	for (const auto& position : positions)
+	{
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+	mesh.center = (minimum + maximum) * 0.5f;
+	mesh.radius = 0.0f;
+	for (const auto& position : positions)
+	{
+		mesh.radius = std::max(mesh.radius, glm::length(position - mesh.center));
+	}
+
+	// LOD 0 is the full mesh, coarser ones are clustered from it with a doubling cell size
+	// and only kept when they drop at least 40% of the previous LOD's triangles
+	struct LodSource
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		float error;
+	};
+	std::vector<LodSource> lodSources;
+	lodSources.push_back(LodSource{ positions, indices, 0.0f });
+
+	float diagonal = glm::length(maximum - minimum);
+	for (float cellSize = diagonal / 1024.0f; cellSize < diagonal && lodSources.size() < gMaxMeshLods; cellSize *= 2.0f)
+	{
+		size_t previousTriangles = lodSources.back().indices.size() / 3;
+		if (previousTriangles <= gMinLodTriangles)
+		{
+			break;
+		}
+
+		LodSource lod;
+		simplifyMesh(positions, indices, cellSize, lod.positions, lod.indices);
+		if (lod.indices.empty())
+		{
+			break;
+		}
+
+		// a vertex moves at most to the far corner of its cell
+		lod.error = cellSize * std::sqrt(3.0f);
+		if (lod.indices.size() / 3 <= previousTriangles * 6 / 10)
+		{
+			lodSources.push_back(std::move(lod));
+		}
+	}
+
+	std::cout << "lod\ttriangles\tvertices\tmeshlets\terror\tacmr before\tacmr after\n";
+	for (size_t i = 0; i < lodSources.size(); ++i)
+	{
+		LodSource& source = lodSources[i];
+		float acmrBefore = computeAcmr(source.indices, (uint32_t)source.positions.size());
+
+		source.indices = optimizeVertexCache(source.indices, (uint32_t)source.positions.size());
+		optimizeVertexFetch(source.positions, source.indices);
+		std::vector<MeshVertex> vertices = computeVertexNormals(source.positions, source.indices);
+		std::vector<Meshlet> meshlets = buildMeshlets(vertices, source.indices, mesh.meshletVertices, mesh.meshletIndices);
+
+		MeshLod lod;
+		lod.vertexOffset = (uint32_t)mesh.vertices.size();
+		lod.vertexCount = (uint32_t)vertices.size();
+		lod.indexOffset = (uint32_t)mesh.indices.size();
+		lod.indexCount = (uint32_t)source.indices.size();
+		lod.meshletOffset = (uint32_t)mesh.meshlets.size();
+		lod.meshletCount = (uint32_t)meshlets.size();
+		lod.error = source.error;
+		mesh.lods.push_back(lod);
+
+		mesh.vertices.insert(mesh.vertices.end(), vertices.begin(), vertices.end());
+		mesh.indices.insert(mesh.indices.end(), source.indices.begin(), source.indices.end());
+		mesh.meshlets.insert(mesh.meshlets.end(), meshlets.begin(), meshlets.end());
+
+		std::cout << i << "\t" << lod.indexCount / 3 << "\t" << lod.vertexCount << "\t" << lod.meshletCount << "\t" << lod.error
+			<< "\t" << acmrBefore << "\t" << computeAcmr(source.indices, lod.vertexCount) << "\n";
+	}
+
+	std::ofstream file(meshFilename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open file!");
+	}
+
+	MeshFileHeader header = { { 'M', 'S', 'H', '2' },
+							  (uint32_t)mesh.lods.size(), (uint32_t)mesh.vertices.size(),
+							  (uint32_t)mesh.indices.size(), (uint32_t)mesh.meshlets.size(),
+							  (uint32_t)mesh.meshletVertices.size(), mesh.center, mesh.radius };
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+	file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex));
+	file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	file.write((const char*)mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+	file.write((const char*)mesh.meshletVertices.data(), mesh.meshletVertices.size() * sizeof(uint32_t));
+	file.write((const char*)mesh.meshletIndices.data(), mesh.meshletIndices.size());
+}
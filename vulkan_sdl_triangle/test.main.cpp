@@ -1,4 +1,5 @@
 #define SDL_MAIN_HANDLED
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <iostream>
 
 #include <SDL2/SDL.h>
@@ -6,13 +7,36 @@
 
 #include <vulkan/vulkan.hpp>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include <set>
+#include <array>
+#include <cmath>
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
 #include <vector>
 #include <limits>
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <functional>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mesh.h"
 
 SDL_Window* gWindow = nullptr;
 const std::string gWindow_title = "SDL_VULKAN_TIANGLE";
@@ -45,20 +69,230 @@ vk::Format gSwapChainImageFormat;
 vk::Extent2D gSwapChainExtent;
 std::vector<vk::Image> gSwapChainImages;
 
-std::vector<vk::UniqueImageView> gSwapChainImageViews;
-
+vk::Format gDepthFormat;
 vk::UniqueRenderPass gRenderPass;
 
 vk::UniquePipelineLayout gPipelineLayout;
 vk::UniquePipeline gGraphicsPipeline;
 
-std::vector<vk::UniqueFramebuffer> gSwapChainFramebuffers;
+// post-processing
+// the scene is rendered into an HDR target, then histogram -> auto exposure -> bloom -> tonemap
+// run as compute passes, and the tonemapped result is blitted to the swap chain image
+const vk::Format gHdrFormat = vk::Format::eR16G16B16A16Sfloat;
+const vk::Format gLdrFormat = vk::Format::eR8G8B8A8Unorm;
+const uint32_t gPostProcessGroupSize = 16;
+const uint32_t gHistogramBinCount = 256;
+const uint32_t gBloomMipCount = 5;
+const float gMinLogLuminance = -10.0f;
+const float gMaxLogLuminance = 2.0f;
+const float gExposureAdaptationRate = 0.05f;
+const float gBloomThreshold = 1.0f;
+const float gBloomFilterRadius = 1.0f;
+const float gBloomStrength = 0.05f;
+
+enum PostProcessTimestamp
+{
+	TIMESTAMP_SCENE,
+	TIMESTAMP_HISTOGRAM,
+	TIMESTAMP_EXPOSURE,
+	TIMESTAMP_BLOOM_DOWNSAMPLE,
+	TIMESTAMP_BLOOM_UPSAMPLE,
+	TIMESTAMP_TONEMAP,
+	TIMESTAMP_COUNT
+};
+
+struct AllocatedImage
+{
+	vk::UniqueDeviceMemory memory;
+	vk::UniqueImage image;
+};
+
+struct AllocatedBuffer
+{
+	vk::UniqueDeviceMemory memory;
+	vk::UniqueBuffer buffer;
+};
+
+struct PostProcessTargets
+{
+	vk::Extent2D extent;
+
+	AllocatedImage hdr;
+	vk::UniqueImageView hdrView;
+	AllocatedImage depth;
+	vk::UniqueImageView depthView;
+	vk::UniqueFramebuffer hdrFramebuffer;
+
+	// half resolution, one view per mip so each pass can sample one level and write the next
+	AllocatedImage bloom;
+	std::vector<vk::UniqueImageView> bloomMipViews;
+
+	AllocatedImage ldr;
+	vk::UniqueImageView ldrView;
+
+	AllocatedBuffer histogram;
+	AllocatedBuffer exposure; // host visible, carries the adapted luminance across frames
+
+	vk::UniqueDescriptorPool descriptorPool;
+	vk::DescriptorSet histogramSet;
+	vk::DescriptorSet exposureSet;
+	std::vector<vk::DescriptorSet> bloomDownsampleSets;
+	std::vector<vk::DescriptorSet> bloomUpsampleSets;
+	vk::DescriptorSet tonemapSet;
+};
+
+vk::UniqueSampler gLinearClampSampler;
+vk::UniqueDescriptorSetLayout gPostProcessSetLayout;
+vk::UniquePipelineLayout gPostProcessPipelineLayout;
+vk::UniquePipeline gHistogramPipeline;
+vk::UniquePipeline gExposurePipeline;
+vk::UniquePipeline gBloomDownsamplePipeline;
+vk::UniquePipeline gBloomUpsamplePipeline;
+vk::UniquePipeline gTonemapPipeline;
+PostProcessTargets gPostProcessTargets;
+
+// texture streaming
+// KTX2 files are memory mapped and only their mip tail is uploaded on load, more detailed mips are
+// streamed in on request and dropped again from the least recently used textures when over budget
+const uint32_t gTextureTailSize = 64;
+const float gTextureBudgetFraction = 0.8f;
+const vk::DeviceSize gTextureUploadBytesPerFrame = 16 * 1024 * 1024;
+const uint32_t gVisibleTextureCount = 4;
+const uint32_t gVisibleTextureSeconds = 3;
+
+struct MappedFile
+{
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	void unmap();
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+struct Ktx2Level
+{
+	uint64_t offset;
+	uint64_t length;
+};
+
+struct StreamedTexture
+{
+	explicit StreamedTexture(const std::string& filename) : file(filename) {}
+
+	MappedFile file;
+	vk::Format format;
+	uint32_t width;
+	uint32_t height;
+	std::vector<Ktx2Level> levels;
+
+	uint32_t tailMip;      // first level of the mip tail, resident for as long as the texture is loaded
+	uint32_t residentMip;  // most detailed level on the GPU, the view starts here. levelCount until the tail landed
+	uint32_t requestedMip;
+	uint64_t lastUsedFrame;
+
+	// images stay in GENERAL, resident levels are copied out of them while frames in flight still sample them
+	AllocatedImage image;
+	vk::UniqueImageView view;
+	vk::DeviceSize residentBytes = 0;
+
+	// residency change still running on the GPU, swapped in by updateTextureStreaming once the fence signals
+	uint32_t pendingMip;
+	AllocatedImage pendingImage;
+	vk::DeviceSize pendingBytes = 0;
+	AllocatedBuffer pendingStaging;
+	vk::UniqueCommandBuffer pendingCommands;
+	vk::UniqueFence pendingFence;
+};
+
+// images replaced by a residency change, kept until no frame in flight can reference them
+struct RetiredTexture
+{
+	uint64_t frame;
+	AllocatedImage image;
+	vk::UniqueImageView view;
+	vk::DeviceSize bytes;
+};
+
+// VK_EXT_memory_budget is newer than the pinned SDK, so its name and struct are spelled out here
+// rather than taken from the headers. the layout matches VkPhysicalDeviceMemoryBudgetPropertiesEXT
+const char* const gMemoryBudgetExtensionName = "VK_EXT_memory_budget";
+const VkStructureType gMemoryBudgetPropertiesType = (VkStructureType)1000237000;
+
+struct MemoryBudgetProperties
+{
+	VkStructureType sType = gMemoryBudgetPropertiesType;
+	void* pNext = nullptr;
+	VkDeviceSize heapBudget[VK_MAX_MEMORY_HEAPS] = {};
+	VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS] = {};
+};
+
+bool gMemoryBudgetSupported = false;
+uint64_t gFrameNumber = 0;
+vk::DeviceSize gTextureResidentBytes = 0;
+vk::DeviceSize gTextureBudgetOverride = 0; // --texture-budget, caps the budget to watch eviction at work
+bool gTextureDemo = false;                  // --texture-demo, simulates a moving visible set over the loaded textures
+std::vector<std::string> gTextureFiles;
+std::vector<std::unique_ptr<StreamedTexture>> gTextures;
+std::vector<RetiredTexture> gRetiredTextures;
+
+// meshes
+// every object draws the coarsest LOD of its .mesh file whose error projects to less than gLodErrorPixels
+const uint32_t gMeshGridSize = 5;
+const float gLodErrorPixels = 1.0f;
+const float gCameraFov = glm::radians(60.0f);
+
+struct LoadedMesh
+{
+	MeshData data;
+	uint32_t baseVertex;
+	uint32_t baseIndex;
+};
+
+struct MeshObject
+{
+	uint32_t mesh;
+	glm::vec3 position;
+};
+
+// written by the CPU every frame, one set per swap chain image
+struct MeshFrameResources
+{
+	AllocatedBuffer objects;  // view projection followed by one model matrix per object
+	AllocatedBuffer drawCommands;
+	glm::mat4* objectData;
+	vk::DrawIndexedIndirectCommand* drawCommandData;
+	vk::DescriptorSet set;
+};
+
+std::vector<std::string> gMeshFiles;
+std::vector<LoadedMesh> gMeshes;
+std::vector<MeshObject> gMeshObjects;
+float gMeshSceneRadius = 0.0f;
+AllocatedBuffer gMeshVertexBuffer;
+AllocatedBuffer gMeshIndexBuffer;
+vk::UniqueDescriptorSetLayout gMeshSetLayout;
+vk::UniquePipelineLayout gMeshPipelineLayout;
+vk::UniquePipeline gMeshPipeline;
+vk::UniqueDescriptorPool gMeshDescriptorPool;
+std::vector<MeshFrameResources> gMeshFrames;
+
 vk::UniqueCommandPool gCommandPool;
 std::vector<vk::UniqueCommandBuffer> gCommandBuffers;
 
 std::vector<vk::UniqueSemaphore> gImageAvailableSemaphores;
 std::vector<vk::UniqueSemaphore> gRenderFinishedSemaphores;
 std::vector<vk::UniqueFence> gInFlightFences;
+std::vector<vk::Fence> gImagesInFlight;
 
 
 bool init();
@@ -68,16 +302,96 @@ void cleanup();
 
 std::vector<char> readFile(const std::string& filename);
 
+uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties);
+AllocatedImage createImage(vk::Extent2D extent, uint32_t mipLevels, vk::Format format, vk::ImageUsageFlags usage);
+AllocatedBuffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties);
+PostProcessTargets createPostProcessTargets(vk::Extent2D extent);
+void recordFrame(vk::CommandBuffer cmd, PostProcessTargets& targets, uint32_t frameIndex, vk::Image swapChainImage, vk::QueryPool timestamps);
+bool runBenchmark();
+
+StreamedTexture* loadTexture(const std::string& filename);
+void requestTextureMip(StreamedTexture* texture, uint32_t mip);
+void updateTextureStreaming();
+
+void submitImmediate(const std::function<void(vk::CommandBuffer)>& record);
+
+void createMeshResources();
+void updateMeshDraws(uint32_t frameIndex);
+
 
 int main(int argc, const char** argv)
 {
+	// --benchmark times every post-processing kernel at several resolutions and exits,
+	// --build-mesh <obj> <mesh> preprocesses a mesh and exits,
+	// --texture-budget <MiB> caps the texture streaming budget,
+	// --texture-demo requests a moving subset of the textures every frame to show streaming and eviction,
+	// other arguments are .mesh files to draw or KTX2 textures to stream
+	bool benchmark = false;
+	std::string buildMeshInput;
+	std::string buildMeshOutput;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		if (argument == "--benchmark")
+		{
+			benchmark = true;
+		}
+		else if (argument == "--build-mesh")
+		{
+			if (i + 2 >= argc)
+			{
+				std::cout << "usage: --build-mesh <input.obj> <output.mesh>\n";
+				return EXIT_FAILURE;
+			}
+			buildMeshInput = argv[++i];
+			buildMeshOutput = argv[++i];
+		}
+		else if (argument == "--texture-demo")
+		{
+			gTextureDemo = true;
+		}
+		else if (argument == "--texture-budget")
+		{
+			// strtoull skips spaces and wraps a '-' around instead of failing, so the value has to start with a digit
+			char* end = nullptr;
+			unsigned long long budget = i + 1 < argc && std::isdigit((unsigned char)argv[i + 1][0]) ? std::strtoull(argv[++i], &end, 10) : 0;
+			if (budget == 0 || *end != '\0' || budget > std::numeric_limits<vk::DeviceSize>::max() / (1024 * 1024))
+			{
+				std::cout << "usage: --texture-budget <MiB>\n";
+				return EXIT_FAILURE;
+			}
+			gTextureBudgetOverride = (vk::DeviceSize)budget * 1024 * 1024;
+		}
+		else if (argument.size() > 5 && argument.compare(argument.size() - 5, 5, ".mesh") == 0)
+		{
+			gMeshFiles.push_back(argument);
+		}
+		else
+		{
+			gTextureFiles.push_back(argument);
+		}
+	}
+
 	try
 	{
+		if (!buildMeshInput.empty())
+		{
+			buildMeshFile(buildMeshInput, buildMeshOutput);
+			return EXIT_SUCCESS;
+		}
+
 		if (!init())
 		{
 			return EXIT_FAILURE;
 		}
 
+		if (benchmark)
+		{
+			bool timed = runBenchmark();
+			cleanup();
+			return timed ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
 		// main loop
 		bool running = true;
 		SDL_Event ev;
@@ -215,9 +529,10 @@ bool init()
 		for (const auto& queueFamily : queueFamilies)
 		{
 			// query if graphics queue 
+			// post-processing runs on the graphics queue, so it has to do compute as well
 			if (queueFamily.queueCount > 0 &&
-				(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) /*&&
-				(queueFamily.queueFlags & vk::QueueFlagBits::eCompute)*/)
+				(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) &&
+				(queueFamily.queueFlags & vk::QueueFlagBits::eCompute))
 			{
 				gGraphicsQueueFamilyIndex = count;
 			}
@@ -247,6 +562,23 @@ Next:
 		return false;
 	}
 
+	// the histogram and exposure kernels reduce within a subgroup before touching shared or global memory
+	vk::PhysicalDeviceSubgroupProperties subgroupProperties;
+	vk::PhysicalDeviceProperties2 physicalDeviceProperties2;
+	physicalDeviceProperties2.setPNext(&subgroupProperties);
+	gSelectedPhysicalDevice.getProperties2(&physicalDeviceProperties2);
+
+	const vk::SubgroupFeatureFlags requiredSubgroupFeatures =
+		vk::SubgroupFeatureFlagBits::eBasic |
+		vk::SubgroupFeatureFlagBits::eBallot |
+		vk::SubgroupFeatureFlagBits::eArithmetic;
+	if (!(subgroupProperties.supportedStages & vk::ShaderStageFlagBits::eCompute) ||
+		(subgroupProperties.supportedOperations & requiredSubgroupFeatures) != requiredSubgroupFeatures)
+	{
+		SDL_Log("selected GPU does not support the subgroup operations needed for post-processing!");
+		return false;
+	}
+
 	//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// create logic device
 	float queuePriority = 1.0f;
@@ -258,9 +590,20 @@ Next:
 		queueCreateInfos.push_back(vk::DeviceQueueCreateInfo(vk::DeviceQueueCreateFlags(), static_cast<uint32_t>(gGraphicsQueueFamilyIndex), 1, &queuePriority));
 	}
 
+	// the texture streamer sizes its budget from VK_EXT_memory_budget when the device has it
+	std::vector<const char*> enabledDeviceExtensions = deviceExtensions;
+	for (const auto& extension : gSelectedPhysicalDevice.enumerateDeviceExtensionProperties())
+	{
+		if (strcmp(extension.extensionName, gMemoryBudgetExtensionName) == 0)
+		{
+			enabledDeviceExtensions.push_back(gMemoryBudgetExtensionName);
+			gMemoryBudgetSupported = true;
+		}
+	}
+
 	vk::DeviceCreateInfo device_create_info(vk::DeviceCreateFlags(), (uint32_t)queueCreateInfos.size(),
 											queueCreateInfos.data(), (uint32_t)validationLayers.size(), validationLayers.data(),
-											(uint32_t)deviceExtensions.size(), deviceExtensions.data());
+											(uint32_t)enabledDeviceExtensions.size(), enabledDeviceExtensions.data());
 
 	gDevice = gSelectedPhysicalDevice.createDeviceUnique(device_create_info);
 
@@ -298,16 +641,25 @@ Next:
 			return surfaceformat;
 		}
 
-		for (const auto& sFormat : availableFormats)
+		// the tonemapped image is blitted in, which converts to any 8 bit layout. UNORM formats are preferred,
+		// for *_SRGB ones the blit does the sRGB encode and tonemap.comp skips its own
+		const vk::Format blitFormats[] = {
+			vk::Format::eB8G8R8A8Unorm, vk::Format::eR8G8B8A8Unorm, vk::Format::eA8B8G8R8UnormPack32,
+			vk::Format::eB8G8R8A8Srgb, vk::Format::eR8G8B8A8Srgb, vk::Format::eA8B8G8R8SrgbPack32
+		};
+		for (vk::Format format : blitFormats)
 		{
-			if (sFormat.format == vk::Format::eB8G8R8A8Unorm && sFormat.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear)
+			for (const auto& sFormat : availableFormats)
 			{
-				return sFormat;
+				if (sFormat.format == format && sFormat.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear &&
+					(gSelectedPhysicalDevice.getFormatProperties(format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst))
+				{
+					return sFormat;
+				}
 			}
 		}
 
-		assert(availableFormats.size() > 0 && "should not reach here");
-		return availableFormats[0];
+		return vk::SurfaceFormatKHR(vk::Format::eUndefined, vk::ColorSpaceKHR::eSrgbNonlinear);
 	};
 
 	auto chooseSwapPresentMode = [](const std::vector<vk::PresentModeKHR>& availablePresentModes) ->vk::PresentModeKHR
@@ -348,7 +700,27 @@ Next:
 
 	auto swapChainSupport = querySwapChainSupport(gSelectedPhysicalDevice, surface);
 
+	// the post-processed image is blitted into the swap chain rather than rendered to it
+	if (!(swapChainSupport.capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst))
+	{
+		SDL_Log("swap chain images can not be used as a transfer destination!");
+		return false;
+	}
+
 	auto surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+
+	if (surfaceFormat.format == vk::Format::eUndefined)
+	{
+		SDL_Log("the surface offers no 8 bit swap chain format the post-processed image can be blitted to!");
+		return false;
+	}
+
+	if (!(gSelectedPhysicalDevice.getFormatProperties(surfaceFormat.format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst))
+	{
+		SDL_Log("swap chain images can not be used as a blit destination!");
+		return false;
+	}
+
 	auto presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 	auto extent = chooseSwapExtent(swapChainSupport.capabilities);
 
@@ -365,7 +737,7 @@ Next:
 		surfaceFormat.colorSpace,
 		extent,
 		1,
-		vk::ImageUsageFlagBits::eColorAttachment,
+		vk::ImageUsageFlagBits::eTransferDst,
 		vk::SharingMode::eExclusive
 	);
 
@@ -398,62 +770,82 @@ Next:
 	gSwapChainExtent = extent;
 
 
-	///////////////////////////////////////////////////////////////////////////////////////////////////////
-	// createImageViews
-	gSwapChainImageViews.resize(gSwapChainImages.size());
-	for (int i = 0; i < gSwapChainImageViews.size(); ++i)
-	{
-		vk::ImageSubresourceRange subresourceRange(
-			vk::ImageAspectFlagBits::eColor,
-			0,
-			1,
-			0,
-			1
-		);
-
-		vk::ImageViewCreateInfo createInfo(vk::ImageViewCreateFlags(),
-										   gSwapChainImages[i],
-										   vk::ImageViewType::e2D,
-										   gSwapChainImageFormat,
-										   vk::ComponentMapping(),
-										   subresourceRange);
-
-		gSwapChainImageViews[i] = gDevice->createImageViewUnique(createInfo);
-	}
-
 	/////////////////////////////////////////////////////////////////////////////////////////
 	// createRenderPass
-	// set framebuffer properties
+	// set framebuffer properties, the scene goes to the HDR target and is left in general layout for the compute passes
 	vk::AttachmentDescription colorAttachmentDesc;
-	colorAttachmentDesc.setFormat(gSwapChainImageFormat);
+	colorAttachmentDesc.setFormat(gHdrFormat);
 	colorAttachmentDesc.setSamples(vk::SampleCountFlagBits::e1);
 	colorAttachmentDesc.setLoadOp(vk::AttachmentLoadOp::eClear);
 	colorAttachmentDesc.setStoreOp(vk::AttachmentStoreOp::eStore);
 	colorAttachmentDesc.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
 	colorAttachmentDesc.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
 	colorAttachmentDesc.setInitialLayout(vk::ImageLayout::eUndefined);
-	colorAttachmentDesc.setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+	colorAttachmentDesc.setFinalLayout(vk::ImageLayout::eGeneral);
+
+	// meshes need a depth buffer, its contents are not needed after the pass
+	gDepthFormat = vk::Format::eUndefined;
+	for (vk::Format candidate : { vk::Format::eD32Sfloat, vk::Format::eX8D24UnormPack32, vk::Format::eD24UnormS8Uint, vk::Format::eD32SfloatS8Uint })
+	{
+		if (gSelectedPhysicalDevice.getFormatProperties(candidate).optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment)
+		{
+			gDepthFormat = candidate;
+			break;
+		}
+	}
+
+	if (gDepthFormat == vk::Format::eUndefined)
+	{
+		SDL_Log("failed to find a supported depth format!");
+		return false;
+	}
+
+	vk::AttachmentDescription depthAttachmentDesc;
+	depthAttachmentDesc.setFormat(gDepthFormat);
+	depthAttachmentDesc.setSamples(vk::SampleCountFlagBits::e1);
+	depthAttachmentDesc.setLoadOp(vk::AttachmentLoadOp::eClear);
+	depthAttachmentDesc.setStoreOp(vk::AttachmentStoreOp::eDontCare);
+	depthAttachmentDesc.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare);
+	depthAttachmentDesc.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare);
+	depthAttachmentDesc.setInitialLayout(vk::ImageLayout::eUndefined);
+	depthAttachmentDesc.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+
+	vk::AttachmentDescription attachmentDescs[] = { colorAttachmentDesc, depthAttachmentDesc };
 
 	vk::AttachmentReference colorAttachmentRef(0, vk::ImageLayout::eColorAttachmentOptimal);
+	vk::AttachmentReference depthAttachmentRef(1, vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
 	vk::SubpassDescription subpass(vk::SubpassDescriptionFlags(),
 								   vk::PipelineBindPoint::eGraphics,
 								   0, nullptr,
-								   1, &colorAttachmentRef);
-
-	vk::SubpassDependency dependency(
-		0, 0,
-		vk::PipelineStageFlagBits::eColorAttachmentOutput,
-		vk::PipelineStageFlagBits::eColorAttachmentOutput,
-		vk::AccessFlags(),
-		vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
-	);
+								   1, &colorAttachmentRef,
+								   nullptr, &depthAttachmentRef);
+
+	// wait for the previous frame's compute passes to stop reading the HDR target and its depth tests to finish
+	// before clearing them, and make the rendered scene visible to this frame's compute passes
+	vk::SubpassDependency dependencies[] = {
+		vk::SubpassDependency(
+			VK_SUBPASS_EXTERNAL, 0,
+			vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite |
+			vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+		),
+		vk::SubpassDependency(
+			0, VK_SUBPASS_EXTERNAL,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput,
+			vk::PipelineStageFlagBits::eComputeShader,
+			vk::AccessFlagBits::eColorAttachmentWrite,
+			vk::AccessFlagBits::eShaderRead
+		)
+	};
 
 	vk::RenderPassCreateInfo renderPassInfo(
 		vk::RenderPassCreateFlags(),
-		1, &colorAttachmentDesc,
+		2, attachmentDescs,
 		1, &subpass,
-		1, &dependency
+		2, dependencies
 	);
 
 	gRenderPass = gDevice->createRenderPassUnique(renderPassInfo);
@@ -495,15 +887,10 @@ Next:
 	inputAssembly.setPrimitiveRestartEnable(VK_FALSE);
 	inputAssembly.setTopology(vk::PrimitiveTopology::eTriangleList);
 
-	// viewport and scissor
-	vk::Viewport viewport(0.0f, 0.0f, (float)gSwapChainExtent.width, (float)gSwapChainExtent.height, 0.0f, 1.0f);
-	vk::Rect2D scissor(vk::Offset2D(0, 0), gSwapChainExtent);
-
+	// viewport and scissor are dynamic, the benchmark renders at other resolutions than the swap chain
 	vk::PipelineViewportStateCreateInfo viewportState;
 	viewportState.setViewportCount(1);
 	viewportState.setScissorCount(1);
-	viewportState.setPViewports(&viewport);
-	viewportState.setPScissors(&scissor);
 
 	// Rasterization
 	vk::PipelineRasterizationStateCreateInfo rasterizerState(vk::PipelineRasterizationStateCreateFlags(),
@@ -523,8 +910,8 @@ Next:
 															VK_FALSE,
 															VK_FALSE);
 
-	// depth and stencil
-	//vk::PipelineDepthStencilStateCreateInfo depth_n_stencil_state;
+	// depth and stencil, the triangle ignores depth
+	vk::PipelineDepthStencilStateCreateInfo depth_n_stencil_state;
 
 
 	// color blending
@@ -542,10 +929,10 @@ Next:
 															 1, &colorBlendAttachment,
 															 { 0.0f, 0.0f, 0.0f, 0.0f });
 
-	//// dynamic states
-	//vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eLineWidth };
-	//vk::PipelineDynamicStateCreateInfo dynamicState(vk::PipelineDynamicStateCreateFlags(),
-	//												2, dynamicStates);
+	// dynamic states
+	vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	vk::PipelineDynamicStateCreateInfo dynamicState(vk::PipelineDynamicStateCreateFlags(),
+													2, dynamicStates);
 
 	// put all pipeline conponents together : VkPipelineLayout 
 	vk::PipelineLayoutCreateInfo pipelineLayoutInfo(vk::PipelineLayoutCreateFlags(), 0, nullptr, 0, nullptr);
@@ -561,11 +948,11 @@ Next:
 		&viewportState,
 		&rasterizerState,
 		&multisampleState,
-		nullptr,
+		&depth_n_stencil_state,
 		&colorBlendingState
 	);
 
-	//pipelineInfo.setPDynamicState(&dynamicState);
+	pipelineInfo.setPDynamicState(&dynamicState);
 	pipelineInfo.setLayout(gPipelineLayout.get());
 	pipelineInfo.setRenderPass(gRenderPass.get());
 	pipelineInfo.setSubpass(0);
@@ -577,20 +964,99 @@ Next:
 
 	gGraphicsPipeline = gDevice->createGraphicsPipelineUnique(nullptr, pipelineInfo);
 
-	// TODO:
-	// frame buffers
-	for (size_t i = 0; i < gSwapChainImageViews.size(); ++i)
-	{
-		vk::FramebufferCreateInfo framebufferInfo(
-			vk::FramebufferCreateFlags(),
-			gRenderPass.get(),
-			1, &gSwapChainImageViews[i].get(),
-			gSwapChainExtent.width, gSwapChainExtent.height,
-			1
-		);
-		gSwapChainFramebuffers.push_back(gDevice->createFramebufferUnique(framebufferInfo));
+	////////////////////////////////////////////////////////////////////////////////////////////
+	// create mesh pipeline when there are meshes to draw, same states as the triangle apart from vertex input, culling and depth
+	if (!gMeshFiles.empty())
+	{
+		vk::DescriptorSetLayoutBinding meshObjectsBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex);
+		gMeshSetLayout = gDevice->createDescriptorSetLayoutUnique(
+			vk::DescriptorSetLayoutCreateInfo(vk::DescriptorSetLayoutCreateFlags(), 1, &meshObjectsBinding));
+
+		vk::PushConstantRange meshPushConstants(vk::ShaderStageFlagBits::eVertex, 0, sizeof(uint32_t));
+		gMeshPipelineLayout = gDevice->createPipelineLayoutUnique(
+			vk::PipelineLayoutCreateInfo(vk::PipelineLayoutCreateFlags(), 1, &gMeshSetLayout.get(), 1, &meshPushConstants));
+
+		auto meshVertShaderModule = createShaderModule(readFile("mesh.vert"));
+		auto meshFragShaderModule = createShaderModule(readFile("mesh.frag"));
+		vk::PipelineShaderStageCreateInfo meshShaderStages[] = {
+			vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, meshVertShaderModule.get(), "main"),
+			vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, meshFragShaderModule.get(), "main")
+		};
+
+		vk::VertexInputBindingDescription meshVertexBinding(0, sizeof(MeshVertex), vk::VertexInputRate::eVertex);
+		vk::VertexInputAttributeDescription meshVertexAttributes[] = {
+			vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(MeshVertex, position)),
+			vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32B32Sfloat, offsetof(MeshVertex, normal))
+		};
+		vk::PipelineVertexInputStateCreateInfo meshVertexInputInfo(vk::PipelineVertexInputStateCreateFlags(),
+																   1, &meshVertexBinding,
+																   2, meshVertexAttributes);
+
+		// OBJ winding is counter clockwise, the projection flips y so it stays that way on screen
+		vk::PipelineRasterizationStateCreateInfo meshRasterizerState = rasterizerState;
+		meshRasterizerState.setFrontFace(vk::FrontFace::eCounterClockwise);
+
+		vk::PipelineDepthStencilStateCreateInfo meshDepthState;
+		meshDepthState.setDepthTestEnable(VK_TRUE);
+		meshDepthState.setDepthWriteEnable(VK_TRUE);
+		meshDepthState.setDepthCompareOp(vk::CompareOp::eLess);
+
+		vk::GraphicsPipelineCreateInfo meshPipelineInfo = pipelineInfo;
+		meshPipelineInfo.setPStages(meshShaderStages);
+		meshPipelineInfo.setPVertexInputState(&meshVertexInputInfo);
+		meshPipelineInfo.setPRasterizationState(&meshRasterizerState);
+		meshPipelineInfo.setPDepthStencilState(&meshDepthState);
+		meshPipelineInfo.setLayout(gMeshPipelineLayout.get());
+
+		gMeshPipeline = gDevice->createGraphicsPipelineUnique(nullptr, meshPipelineInfo);
 	}
 
+	////////////////////////////////////////////////////////////////////////////////////////////
+	// create post-processing pipelines
+	vk::SamplerCreateInfo samplerInfo;
+	samplerInfo.setMagFilter(vk::Filter::eLinear);
+	samplerInfo.setMinFilter(vk::Filter::eLinear);
+	samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eNearest);
+	samplerInfo.setAddressModeU(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setAddressModeV(vk::SamplerAddressMode::eClampToEdge);
+	samplerInfo.setAddressModeW(vk::SamplerAddressMode::eClampToEdge);
+	gLinearClampSampler = gDevice->createSamplerUnique(samplerInfo);
+
+	// all kernels share one layout, each only declares the bindings it uses:
+	// 0 storage image read, 1 storage image write, 2 sampled image, 3 histogram, 4 exposure
+	vk::DescriptorSetLayoutBinding postProcessBindings[] = {
+		vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute),
+		vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+	};
+	gPostProcessSetLayout = gDevice->createDescriptorSetLayoutUnique(
+		vk::DescriptorSetLayoutCreateInfo(vk::DescriptorSetLayoutCreateFlags(), 5, postProcessBindings));
+
+	vk::PushConstantRange postProcessPushConstants(vk::ShaderStageFlagBits::eCompute, 0, 16);
+	gPostProcessPipelineLayout = gDevice->createPipelineLayoutUnique(
+		vk::PipelineLayoutCreateInfo(vk::PipelineLayoutCreateFlags(), 1, &gPostProcessSetLayout.get(), 1, &postProcessPushConstants));
+
+	auto createComputePipeline = [&createShaderModule](const std::string& filename) -> vk::UniquePipeline
+	{
+		auto shaderModule = createShaderModule(readFile(filename));
+		vk::ComputePipelineCreateInfo computePipelineInfo(
+			vk::PipelineCreateFlags(),
+			vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eCompute, shaderModule.get(), "main"),
+			gPostProcessPipelineLayout.get()
+		);
+		return gDevice->createComputePipelineUnique(nullptr, computePipelineInfo);
+	};
+
+	gHistogramPipeline = createComputePipeline("luminance_histogram.comp");
+	gExposurePipeline = createComputePipeline("auto_exposure.comp");
+	gBloomDownsamplePipeline = createComputePipeline("bloom_downsample.comp");
+	gBloomUpsamplePipeline = createComputePipeline("bloom_upsample.comp");
+	gTonemapPipeline = createComputePipeline("tonemap.comp");
+
+	gPostProcessTargets = createPostProcessTargets(gSwapChainExtent);
+
 	// create command pool
 	vk::CommandPoolCreateInfo poolInfo(
 		vk::CommandPoolCreateFlags(),
@@ -602,30 +1068,18 @@ Next:
 	vk::CommandBufferAllocateInfo cmdBufferAllocInfo(
 		gCommandPool.get(),
 		vk::CommandBufferLevel::ePrimary,
-		(uint32_t)gSwapChainFramebuffers.size()
+		(uint32_t)gSwapChainImages.size()
 	);
 	gCommandBuffers = gDevice->allocateCommandBuffersUnique(cmdBufferAllocInfo);
 
+	// meshes are uploaded before recording, the per object draws are indirect and filled in every frame
+	createMeshResources();
+
 	// record command
 	for (size_t i = 0; i < gCommandBuffers.size(); i++)
 	{
 		gCommandBuffers[i]->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse));
-
-		vk::ClearValue clearColor;
-		clearColor.color.setFloat32({ 0.0f, 0.0f, 0.0f, 1.0f });
-
-		vk::RenderPassBeginInfo renderPassBeginInfo(
-			gRenderPass.get(),
-			gSwapChainFramebuffers[i].get(),
-			vk::Rect2D(vk::Offset2D(0, 0), gSwapChainExtent),
-			1, &clearColor
-		);
-
-		gCommandBuffers[i]->beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-		gCommandBuffers[i]->bindPipeline(vk::PipelineBindPoint::eGraphics, gGraphicsPipeline.get());
-		gCommandBuffers[i]->draw(3, 1, 0, 0);
-		gCommandBuffers[i]->endRenderPass();
-
+		recordFrame(gCommandBuffers[i].get(), gPostProcessTargets, (uint32_t)i, gSwapChainImages[i], nullptr);
 		gCommandBuffers[i]->end();
 	}
 
@@ -639,12 +1093,37 @@ Next:
 		gRenderFinishedSemaphores.push_back(gDevice->createSemaphoreUnique(vk::SemaphoreCreateInfo()));
 		gInFlightFences.push_back(gDevice->createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled)));
 	}
+	gImagesInFlight.resize(gSwapChainImages.size());
+
+	// load textures, only their mip tail goes to the GPU here
+	for (const auto& filename : gTextureFiles)
+	{
+		loadTexture(filename);
+	}
 
 	return true;
 }
 
 void update()
 {
+	++gFrameNumber;
+
+	// textures are streamed in as far as requestTextureMip asks for. nothing draws them yet, so with --texture-demo
+	// a window sliding over them every few seconds stands in for the visible set: visible textures ask for the level
+	// that would cover the window, the ones that left it become eviction candidates
+	if (gTextureDemo && !gTextures.empty())
+	{
+		size_t visibleCount = std::min<size_t>(gVisibleTextureCount, gTextures.size());
+		size_t firstVisible = (SDL_GetTicks() / (gVisibleTextureSeconds * 1000)) % gTextures.size();
+		for (size_t i = 0; i < visibleCount; ++i)
+		{
+			StreamedTexture* texture = gTextures[(firstVisible + i) % gTextures.size()].get();
+			float scale = std::max((float)texture->width / gSwapChainExtent.width, (float)texture->height / gSwapChainExtent.height);
+			requestTextureMip(texture, scale > 1.0f ? (uint32_t)std::floor(std::log2(scale)) : 0);
+		}
+	}
+
+	updateTextureStreaming();
 }
 
 void render()
@@ -654,11 +1133,21 @@ void render()
 	static uint32_t imageIndex = -1;
 
 	gDevice->waitForFences(1, &gInFlightFences[currentFrame].get(), VK_TRUE, std::numeric_limits<uint64_t>::max());
-	gDevice->resetFences(1, &gInFlightFences[currentFrame].get());
 
 	imageIndex = gDevice->acquireNextImageKHR(gSwapChain, std::numeric_limits<uint64_t>::max(), gImageAvailableSemaphores[currentFrame].get(), nullptr).value;
 
-	vk::PipelineStageFlags flags[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+	// the image's command buffer reads per frame mesh data, so its last submission has to be done before that is rewritten
+	if (gImagesInFlight[imageIndex])
+	{
+		gDevice->waitForFences(1, &gImagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	gImagesInFlight[imageIndex] = gInFlightFences[currentFrame].get();
+	gDevice->resetFences(1, &gInFlightFences[currentFrame].get());
+
+	updateMeshDraws(imageIndex);
+
+	// the swap chain image is first touched by the blit at the end of the frame
+	vk::PipelineStageFlags flags[] = { vk::PipelineStageFlagBits::eTransfer };
 
 	vk::SubmitInfo submitInfo(
 		1, &gImageAvailableSemaphores[currentFrame].get(),
@@ -688,6 +1177,10 @@ void cleanup()
 {
 	gDevice->waitIdle();
 
+	// a residency change in flight holds a command buffer from gCommandPool, which is destroyed before gTextures
+	gTextures.clear();
+	gRetiredTextures.clear();
+
 	gDevice->destroySwapchainKHR(gSwapChain);
 	gVKInstance->destroySurfaceKHR(gSurface);
 	SDL_DestroyWindow(gWindow);
@@ -716,3 +1209,1381 @@ std::vector<char> readFile(const std::string & filename)
 	return buffer;
 }
 
+
+uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
+{
+	vk::PhysicalDeviceMemoryProperties memoryProperties = gSelectedPhysicalDevice.getMemoryProperties();
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+	{
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+AllocatedImage createImage(vk::Extent2D extent, uint32_t mipLevels, vk::Format format, vk::ImageUsageFlags usage)
+{
+	AllocatedImage result;
+
+	vk::ImageCreateInfo imageInfo(
+		vk::ImageCreateFlags(),
+		vk::ImageType::e2D,
+		format,
+		vk::Extent3D(extent.width, extent.height, 1),
+		mipLevels,
+		1,
+		vk::SampleCountFlagBits::e1,
+		vk::ImageTiling::eOptimal,
+		usage,
+		vk::SharingMode::eExclusive
+	);
+	result.image = gDevice->createImageUnique(imageInfo);
+
+	vk::MemoryRequirements memoryRequirements = gDevice->getImageMemoryRequirements(result.image.get());
+	result.memory = gDevice->allocateMemoryUnique(vk::MemoryAllocateInfo(
+		memoryRequirements.size,
+		findMemoryType(memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal)));
+	gDevice->bindImageMemory(result.image.get(), result.memory.get(), 0);
+
+	return result;
+}
+
+AllocatedBuffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties)
+{
+	AllocatedBuffer result;
+
+	result.buffer = gDevice->createBufferUnique(vk::BufferCreateInfo(vk::BufferCreateFlags(), size, usage, vk::SharingMode::eExclusive));
+
+	vk::MemoryRequirements memoryRequirements = gDevice->getBufferMemoryRequirements(result.buffer.get());
+	result.memory = gDevice->allocateMemoryUnique(vk::MemoryAllocateInfo(
+		memoryRequirements.size,
+		findMemoryType(memoryRequirements.memoryTypeBits, properties)));
+	gDevice->bindBufferMemory(result.buffer.get(), result.memory.get(), 0);
+
+	return result;
+}
+
+static vk::Extent2D bloomMipExtent(vk::Extent2D extent, uint32_t mip)
+{
+	return vk::Extent2D(std::max(1u, (extent.width / 2) >> mip), std::max(1u, (extent.height / 2) >> mip));
+}
+
+PostProcessTargets createPostProcessTargets(vk::Extent2D extent)
+{
+	PostProcessTargets targets;
+	targets.extent = extent;
+
+	auto createView = [](vk::Image image, vk::Format format, uint32_t mip) -> vk::UniqueImageView
+	{
+		vk::ImageViewCreateInfo createInfo(vk::ImageViewCreateFlags(),
+										   image,
+										   vk::ImageViewType::e2D,
+										   format,
+										   vk::ComponentMapping(),
+										   vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, mip, 1, 0, 1));
+		return gDevice->createImageViewUnique(createInfo);
+	};
+
+	// images
+	targets.hdr = createImage(extent, 1, gHdrFormat,
+							  vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled);
+	targets.hdrView = createView(targets.hdr.image.get(), gHdrFormat, 0);
+
+	targets.depth = createImage(extent, 1, gDepthFormat, vk::ImageUsageFlagBits::eDepthStencilAttachment);
+	vk::ImageAspectFlags depthAspect = vk::ImageAspectFlagBits::eDepth;
+	if (gDepthFormat == vk::Format::eD24UnormS8Uint || gDepthFormat == vk::Format::eD32SfloatS8Uint)
+	{
+		depthAspect |= vk::ImageAspectFlagBits::eStencil;
+	}
+	vk::ImageViewCreateInfo depthViewInfo(vk::ImageViewCreateFlags(),
+										  targets.depth.image.get(),
+										  vk::ImageViewType::e2D,
+										  gDepthFormat,
+										  vk::ComponentMapping(),
+										  vk::ImageSubresourceRange(depthAspect, 0, 1, 0, 1));
+	targets.depthView = gDevice->createImageViewUnique(depthViewInfo);
+
+	vk::ImageView framebufferAttachments[] = { targets.hdrView.get(), targets.depthView.get() };
+	vk::FramebufferCreateInfo framebufferInfo(
+		vk::FramebufferCreateFlags(),
+		gRenderPass.get(),
+		2, framebufferAttachments,
+		extent.width, extent.height,
+		1
+	);
+	targets.hdrFramebuffer = gDevice->createFramebufferUnique(framebufferInfo);
+
+	targets.bloom = createImage(bloomMipExtent(extent, 0), gBloomMipCount, gHdrFormat,
+								vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled);
+	for (uint32_t mip = 0; mip < gBloomMipCount; ++mip)
+	{
+		targets.bloomMipViews.push_back(createView(targets.bloom.image.get(), gHdrFormat, mip));
+	}
+
+	targets.ldr = createImage(extent, 1, gLdrFormat,
+							  vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc);
+	targets.ldrView = createView(targets.ldr.image.get(), gLdrFormat, 0);
+
+	// buffers
+	targets.histogram = createBuffer(gHistogramBinCount * sizeof(uint32_t),
+									 vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+									 vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+	const float initialExposure[] = { 1.0f, 0.18f }; // average luminance, exposure
+	targets.exposure = createBuffer(sizeof(initialExposure),
+									vk::BufferUsageFlagBits::eStorageBuffer,
+									vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	void* mapped = gDevice->mapMemory(targets.exposure.memory.get(), 0, sizeof(initialExposure));
+	memcpy(mapped, initialExposure, sizeof(initialExposure));
+	gDevice->unmapMemory(targets.exposure.memory.get());
+
+	// descriptor sets: histogram, exposure, one per bloom pass and tonemap
+	uint32_t setCount = 3 + gBloomMipCount + (gBloomMipCount - 1);
+	vk::DescriptorPoolSize poolSizes[] = {
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, 2 * gBloomMipCount + 2),
+		vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 2 * gBloomMipCount),
+		vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 4)
+	};
+	targets.descriptorPool = gDevice->createDescriptorPoolUnique(
+		vk::DescriptorPoolCreateInfo(vk::DescriptorPoolCreateFlags(), setCount, 3, poolSizes));
+
+	std::vector<vk::DescriptorSetLayout> setLayouts(setCount, gPostProcessSetLayout.get());
+	std::vector<vk::DescriptorSet> sets = gDevice->allocateDescriptorSets(
+		vk::DescriptorSetAllocateInfo(targets.descriptorPool.get(), setCount, setLayouts.data()));
+
+	targets.histogramSet = sets[0];
+	targets.exposureSet = sets[1];
+	targets.tonemapSet = sets[2];
+	targets.bloomDownsampleSets.assign(sets.begin() + 3, sets.begin() + 3 + gBloomMipCount);
+	targets.bloomUpsampleSets.assign(sets.begin() + 3 + gBloomMipCount, sets.end());
+
+	// every image stays in general layout for the whole post-processing chain
+	auto writeImage = [](vk::DescriptorSet set, uint32_t binding, vk::DescriptorType type, vk::ImageView view)
+	{
+		vk::DescriptorImageInfo imageInfo(
+			type == vk::DescriptorType::eCombinedImageSampler ? gLinearClampSampler.get() : vk::Sampler(),
+			view,
+			vk::ImageLayout::eGeneral);
+		gDevice->updateDescriptorSets(vk::WriteDescriptorSet(set, binding, 0, 1, type, &imageInfo), nullptr);
+	};
+
+	auto writeBuffer = [](vk::DescriptorSet set, uint32_t binding, vk::Buffer buffer)
+	{
+		vk::DescriptorBufferInfo bufferInfo(buffer, 0, VK_WHOLE_SIZE);
+		gDevice->updateDescriptorSets(vk::WriteDescriptorSet(set, binding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo), nullptr);
+	};
+
+	writeImage(targets.histogramSet, 0, vk::DescriptorType::eStorageImage, targets.hdrView.get());
+	writeBuffer(targets.histogramSet, 3, targets.histogram.buffer.get());
+
+	writeBuffer(targets.exposureSet, 3, targets.histogram.buffer.get());
+	writeBuffer(targets.exposureSet, 4, targets.exposure.buffer.get());
+
+	for (uint32_t mip = 0; mip < gBloomMipCount; ++mip)
+	{
+		vk::ImageView source = mip == 0 ? targets.hdrView.get() : targets.bloomMipViews[mip - 1].get();
+		writeImage(targets.bloomDownsampleSets[mip], 1, vk::DescriptorType::eStorageImage, targets.bloomMipViews[mip].get());
+		writeImage(targets.bloomDownsampleSets[mip], 2, vk::DescriptorType::eCombinedImageSampler, source);
+	}
+
+	for (uint32_t mip = 0; mip + 1 < gBloomMipCount; ++mip)
+	{
+		writeImage(targets.bloomUpsampleSets[mip], 1, vk::DescriptorType::eStorageImage, targets.bloomMipViews[mip].get());
+		writeImage(targets.bloomUpsampleSets[mip], 2, vk::DescriptorType::eCombinedImageSampler, targets.bloomMipViews[mip + 1].get());
+	}
+
+	writeImage(targets.tonemapSet, 0, vk::DescriptorType::eStorageImage, targets.hdrView.get());
+	writeImage(targets.tonemapSet, 1, vk::DescriptorType::eStorageImage, targets.ldrView.get());
+	writeImage(targets.tonemapSet, 2, vk::DescriptorType::eCombinedImageSampler, targets.bloomMipViews[0].get());
+	writeBuffer(targets.tonemapSet, 4, targets.exposure.buffer.get());
+
+	return targets;
+}
+
+void recordFrame(vk::CommandBuffer cmd, PostProcessTargets& targets, uint32_t frameIndex, vk::Image swapChainImage, vk::QueryPool timestamps)
+{
+	struct HistogramPushConstants
+	{
+		float minLogLuminance;
+		float inverseLogLuminanceRange;
+	};
+
+	struct ExposurePushConstants
+	{
+		float minLogLuminance;
+		float logLuminanceRange;
+		float pixelCount;
+		float adaptationRate;
+	};
+
+	struct BloomPushConstants
+	{
+		glm::vec2 srcTexelSize;
+		float thresholdOrRadius; // threshold for the downsample, filter radius for the upsample
+		uint32_t applyThreshold;
+	};
+
+	struct TonemapPushConstants
+	{
+		float bloomStrength;
+		uint32_t encodeSrgb;
+	};
+
+	auto dispatch2D = [cmd](vk::Extent2D size)
+	{
+		cmd.dispatch((size.width + gPostProcessGroupSize - 1) / gPostProcessGroupSize,
+					 (size.height + gPostProcessGroupSize - 1) / gPostProcessGroupSize,
+					 1);
+	};
+
+	// every pass consumes what the previous one wrote
+	auto computeBarrier = [cmd]()
+	{
+		vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+							vk::DependencyFlags(), barrier, nullptr, nullptr);
+	};
+
+	auto writeTimestamp = [cmd, timestamps](PostProcessTimestamp query)
+	{
+		if (timestamps)
+		{
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestamps, query);
+		}
+	};
+
+	auto pushConstants = [cmd](const void* data, uint32_t size)
+	{
+		cmd.pushConstants(gPostProcessPipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, size, data);
+	};
+
+	vk::ImageSubresourceRange colorRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+	vk::ImageSubresourceRange bloomRange(vk::ImageAspectFlagBits::eColor, 0, gBloomMipCount, 0, 1);
+
+	if (timestamps)
+	{
+		cmd.resetQueryPool(timestamps, 0, TIMESTAMP_COUNT);
+	}
+
+	// last frame's bloom and tonemap results are not needed anymore, and the histogram starts from zero
+	std::array<vk::ImageMemoryBarrier, 2> discardBarriers = {
+		vk::ImageMemoryBarrier(vk::AccessFlags(), vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+							   vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+							   VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+							   targets.bloom.image.get(), bloomRange),
+		vk::ImageMemoryBarrier(vk::AccessFlags(), vk::AccessFlagBits::eShaderWrite,
+							   vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+							   VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+							   targets.ldr.image.get(), colorRange)
+	};
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+						vk::PipelineStageFlagBits::eComputeShader,
+						vk::DependencyFlags(), nullptr, nullptr, discardBarriers);
+
+	cmd.fillBuffer(targets.histogram.buffer.get(), 0, VK_WHOLE_SIZE, 0);
+	vk::MemoryBarrier clearBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+						vk::DependencyFlags(), clearBarrier, nullptr, nullptr);
+
+	// draw the scene into the HDR target
+	vk::ClearValue clearValues[2];
+	clearValues[0].color.setFloat32({ 0.0f, 0.0f, 0.0f, 1.0f });
+	clearValues[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
+
+	vk::RenderPassBeginInfo renderPassBeginInfo(
+		gRenderPass.get(),
+		targets.hdrFramebuffer.get(),
+		vk::Rect2D(vk::Offset2D(0, 0), targets.extent),
+		2, clearValues
+	);
+
+	cmd.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+	cmd.setViewport(0, vk::Viewport(0.0f, 0.0f, (float)targets.extent.width, (float)targets.extent.height, 0.0f, 1.0f));
+	cmd.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), targets.extent));
+	if (gMeshObjects.empty())
+	{
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, gGraphicsPipeline.get());
+		cmd.draw(3, 1, 0, 0);
+	}
+	else
+	{
+		// one indirect draw per object, updateMeshDraws picks the LOD by writing the command
+		const MeshFrameResources& frame = gMeshFrames[frameIndex];
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, gMeshPipeline.get());
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, gMeshPipelineLayout.get(), 0, frame.set, nullptr);
+		cmd.bindVertexBuffers(0, gMeshVertexBuffer.buffer.get(), vk::DeviceSize(0));
+		cmd.bindIndexBuffer(gMeshIndexBuffer.buffer.get(), 0, vk::IndexType::eUint32);
+		for (uint32_t object = 0; object < gMeshObjects.size(); ++object)
+		{
+			cmd.pushConstants(gMeshPipelineLayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(object), &object);
+			cmd.drawIndexedIndirect(frame.drawCommands.buffer.get(), object * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
+		}
+	}
+	cmd.endRenderPass();
+	writeTimestamp(TIMESTAMP_SCENE);
+
+	// luminance histogram
+	HistogramPushConstants histogramConstants = { gMinLogLuminance, 1.0f / (gMaxLogLuminance - gMinLogLuminance) };
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, gHistogramPipeline.get());
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, gPostProcessPipelineLayout.get(), 0, targets.histogramSet, nullptr);
+	pushConstants(&histogramConstants, sizeof(histogramConstants));
+	dispatch2D(targets.extent);
+	computeBarrier();
+	writeTimestamp(TIMESTAMP_HISTOGRAM);
+
+	// auto exposure, a single workgroup with one invocation per bin
+	ExposurePushConstants exposureConstants = {
+		gMinLogLuminance,
+		gMaxLogLuminance - gMinLogLuminance,
+		(float)targets.extent.width * (float)targets.extent.height,
+		gExposureAdaptationRate
+	};
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, gExposurePipeline.get());
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, gPostProcessPipelineLayout.get(), 0, targets.exposureSet, nullptr);
+	pushConstants(&exposureConstants, sizeof(exposureConstants));
+	cmd.dispatch(1, 1, 1);
+	computeBarrier();
+	writeTimestamp(TIMESTAMP_EXPOSURE);
+
+	// bloom downsample chain, the first pass reads the HDR target and applies the threshold
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, gBloomDownsamplePipeline.get());
+	for (uint32_t mip = 0; mip < gBloomMipCount; ++mip)
+	{
+		vk::Extent2D srcExtent = mip == 0 ? targets.extent : bloomMipExtent(targets.extent, mip - 1);
+		BloomPushConstants bloomConstants = {
+			glm::vec2(1.0f / srcExtent.width, 1.0f / srcExtent.height),
+			gBloomThreshold,
+			mip == 0 ? 1u : 0u
+		};
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, gPostProcessPipelineLayout.get(), 0, targets.bloomDownsampleSets[mip], nullptr);
+		pushConstants(&bloomConstants, sizeof(bloomConstants));
+		dispatch2D(bloomMipExtent(targets.extent, mip));
+		computeBarrier();
+	}
+	writeTimestamp(TIMESTAMP_BLOOM_DOWNSAMPLE);
+
+	// bloom upsample chain, each mip accumulates the blurred one below it
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, gBloomUpsamplePipeline.get());
+	for (uint32_t mip = gBloomMipCount - 1; mip-- > 0;)
+	{
+		vk::Extent2D srcExtent = bloomMipExtent(targets.extent, mip + 1);
+		BloomPushConstants bloomConstants = {
+			glm::vec2(1.0f / srcExtent.width, 1.0f / srcExtent.height),
+			gBloomFilterRadius,
+			0u
+		};
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, gPostProcessPipelineLayout.get(), 0, targets.bloomUpsampleSets[mip], nullptr);
+		pushConstants(&bloomConstants, sizeof(bloomConstants));
+		dispatch2D(bloomMipExtent(targets.extent, mip));
+		computeBarrier();
+	}
+	writeTimestamp(TIMESTAMP_BLOOM_UPSAMPLE);
+
+	// tonemap
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, gTonemapPipeline.get());
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, gPostProcessPipelineLayout.get(), 0, targets.tonemapSet, nullptr);
+	// *_SRGB swap chains encode when the image is blitted in
+	bool srgbSwapChain = gSwapChainImageFormat == vk::Format::eB8G8R8A8Srgb || gSwapChainImageFormat == vk::Format::eR8G8B8A8Srgb ||
+		gSwapChainImageFormat == vk::Format::eA8B8G8R8SrgbPack32;
+	TonemapPushConstants tonemapConstants = { gBloomStrength, srgbSwapChain ? 0u : 1u };
+	pushConstants(&tonemapConstants, sizeof(tonemapConstants));
+	dispatch2D(targets.extent);
+	writeTimestamp(TIMESTAMP_TONEMAP);
+
+	if (!swapChainImage)
+	{
+		return;
+	}
+
+	// copy the tonemapped image into the swap chain, the blit also converts RGBA to the swap chain's format
+	vk::MemoryBarrier tonemapBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead);
+	vk::ImageMemoryBarrier toTransferDst(vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite,
+										 vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+										 VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+										 swapChainImage, colorRange);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+						vk::PipelineStageFlagBits::eTransfer,
+						vk::DependencyFlags(), tonemapBarrier, nullptr, toTransferDst);
+
+	vk::ImageSubresourceLayers colorLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+	std::array<vk::Offset3D, 2> blitOffsets = { vk::Offset3D(0, 0, 0),
+												vk::Offset3D((int32_t)targets.extent.width, (int32_t)targets.extent.height, 1) };
+	vk::ImageBlit blitRegion(colorLayers, blitOffsets, colorLayers, blitOffsets);
+	cmd.blitImage(targets.ldr.image.get(), vk::ImageLayout::eGeneral,
+				  swapChainImage, vk::ImageLayout::eTransferDstOptimal,
+				  blitRegion, vk::Filter::eNearest);
+
+	vk::ImageMemoryBarrier toPresent(vk::AccessFlagBits::eTransferWrite, vk::AccessFlags(),
+									 vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::ePresentSrcKHR,
+									 VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+									 swapChainImage, colorRange);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+						vk::DependencyFlags(), nullptr, nullptr, toPresent);
+}
+
+bool runBenchmark()
+{
+	const uint32_t warmupIterations = 16;
+	const uint32_t measuredIterations = 128;
+	const vk::Extent2D resolutions[] = {
+		vk::Extent2D(1280, 720),
+		vk::Extent2D(1920, 1080),
+		vk::Extent2D(2560, 1440),
+		vk::Extent2D(3840, 2160)
+	};
+	const char* kernelNames[] = { "histogram", "exposure", "bloom down", "bloom up", "tonemap" };
+
+	vk::PhysicalDeviceProperties properties = gSelectedPhysicalDevice.getProperties();
+	auto queueFamilies = gSelectedPhysicalDevice.getQueueFamilyProperties();
+	if (queueFamilies[gGraphicsQueueFamilyIndex].timestampValidBits == 0)
+	{
+		SDL_Log("graphics queue does not support timestamps, can not run the benchmark!");
+		return false;
+	}
+
+	vk::UniqueQueryPool queryPool = gDevice->createQueryPoolUnique(
+		vk::QueryPoolCreateInfo(vk::QueryPoolCreateFlags(), vk::QueryType::eTimestamp, TIMESTAMP_COUNT));
+	vk::UniqueFence fence = gDevice->createFenceUnique(vk::FenceCreateInfo());
+
+	std::cout << "post-processing kernel timings (ms, average of " << measuredIterations << " frames)\n";
+	std::cout << "resolution";
+	for (const char* name : kernelNames)
+	{
+		std::cout << "\t" << name;
+	}
+	std::cout << "\ttotal\n";
+
+	// the scene pass draws frame 0's indirect commands, which nothing has filled in yet
+	updateMeshDraws(0);
+
+	for (const auto& resolution : resolutions)
+	{
+		PostProcessTargets targets = createPostProcessTargets(resolution);
+
+		auto cmdBuffers = gDevice->allocateCommandBuffersUnique(
+			vk::CommandBufferAllocateInfo(gCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1));
+		cmdBuffers[0]->begin(vk::CommandBufferBeginInfo());
+		recordFrame(cmdBuffers[0].get(), targets, 0, nullptr, queryPool.get());
+		cmdBuffers[0]->end();
+
+		double kernelTotals[TIMESTAMP_COUNT - 1] = {};
+		for (uint32_t iteration = 0; iteration < warmupIterations + measuredIterations; ++iteration)
+		{
+			vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmdBuffers[0].get());
+			gGraphicsQueue.submit(1, &submitInfo, fence.get());
+			gDevice->waitForFences(1, &fence.get(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+			gDevice->resetFences(1, &fence.get());
+
+			if (iteration < warmupIterations)
+			{
+				continue;
+			}
+
+			uint64_t ticks[TIMESTAMP_COUNT];
+			gDevice->getQueryPoolResults(queryPool.get(), 0, TIMESTAMP_COUNT, sizeof(ticks), ticks, sizeof(uint64_t),
+										 vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+			for (int i = 0; i < TIMESTAMP_COUNT - 1; ++i)
+			{
+				kernelTotals[i] += (ticks[i + 1] - ticks[i]) * properties.limits.timestampPeriod * 1e-6;
+			}
+		}
+
+		double total = 0.0;
+		std::cout << resolution.width << "x" << resolution.height;
+		for (int i = 0; i < TIMESTAMP_COUNT - 1; ++i)
+		{
+			double average = kernelTotals[i] / measuredIterations;
+			total += average;
+			std::cout << "\t" << average;
+		}
+		std::cout << "\t" << total << "\n";
+	}
+
+	return true;
+}
+
+MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef _WIN32
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER fileSize;
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+	{
+		unmap();
+		throw std::runtime_error("failed to open file!");
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		unmap();
+		throw std::runtime_error("failed to map file!");
+	}
+	data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	fd = open(filename.c_str(), O_RDONLY);
+	struct stat fileStat;
+	if (fd < 0 || fstat(fd, &fileStat) != 0)
+	{
+		unmap();
+		throw std::runtime_error("failed to open file!");
+	}
+	size = (size_t)fileStat.st_size;
+
+	void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	data = mapped == MAP_FAILED ? nullptr : (const uint8_t*)mapped;
+#endif
+
+	if (!data)
+	{
+		unmap();
+		throw std::runtime_error("failed to map file!");
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+	{
+		munmap((void*)data, size);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	fd = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+// record and run a one off command buffer, waiting for it to finish
+void submitImmediate(const std::function<void(vk::CommandBuffer)>& record)
+{
+	vk::UniqueCommandBuffer cmd = std::move(gDevice->allocateCommandBuffersUnique(
+		vk::CommandBufferAllocateInfo(gCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1))[0]);
+	cmd->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	record(cmd.get());
+	cmd->end();
+
+	vk::UniqueFence fence = gDevice->createFenceUnique(vk::FenceCreateInfo());
+	vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmd.get());
+	gGraphicsQueue.submit(1, &submitInfo, fence.get());
+	gDevice->waitForFences(1, &fence.get(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+static vk::DeviceSize queryTextureBudget()
+{
+	vk::PhysicalDeviceMemoryProperties memoryProperties = gSelectedPhysicalDevice.getMemoryProperties();
+
+	// textures live in the largest device local heap, heap 0 is not necessarily one of them
+	uint32_t heap = memoryProperties.memoryHeapCount;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+	{
+		if ((memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) &&
+			(heap == memoryProperties.memoryHeapCount || memoryProperties.memoryHeaps[i].size > memoryProperties.memoryHeaps[heap].size))
+		{
+			heap = i;
+		}
+	}
+
+	if (gMemoryBudgetSupported)
+	{
+		MemoryBudgetProperties budgetProperties;
+		vk::PhysicalDeviceMemoryProperties2 memoryProperties2;
+		memoryProperties2.setPNext(&budgetProperties);
+		gSelectedPhysicalDevice.getMemoryProperties2(&memoryProperties2);
+
+		// whatever else is on the heap, ours or other processes', is paid for first
+		vk::DeviceSize heapBudget = (vk::DeviceSize)(budgetProperties.heapBudget[heap] * gTextureBudgetFraction);
+		vk::DeviceSize otherUsage = budgetProperties.heapUsage[heap] - std::min(budgetProperties.heapUsage[heap], gTextureResidentBytes);
+		return heapBudget > otherUsage ? heapBudget - otherUsage : 0;
+	}
+
+	// without the extension the heap size is all there is to go on
+	return (vk::DeviceSize)(memoryProperties.memoryHeaps[heap].size * gTextureBudgetFraction);
+}
+
+// size of levels [mip, levelCount) in the file, loadTexture checked each one against the format and extent
+static vk::DeviceSize textureLevelBytes(const StreamedTexture& texture, uint32_t mip)
+{
+	vk::DeviceSize bytes = 0;
+	for (uint32_t level = mip; level < texture.levels.size(); ++level)
+	{
+		bytes += texture.levels[level].length;
+	}
+	return bytes;
+}
+
+// start moving the texture to levels [mip, levelCount) in a new image: levels that are already resident are copied
+// over from the current image on the GPU and only the missing ones are uploaded from the mapped file.
+// nothing waits here, updateTextureStreaming swaps the image in once its fence signals. returns the bytes uploaded
+static vk::DeviceSize beginTextureResidency(StreamedTexture& texture, uint32_t mip)
+{
+	uint32_t levelCount = (uint32_t)texture.levels.size() - mip;
+	vk::Extent2D extent(std::max(1u, texture.width >> mip), std::max(1u, texture.height >> mip));
+	AllocatedImage image = createImage(extent, levelCount, texture.format,
+									   vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst);
+
+	// offsets stay 16 byte aligned, which covers every block size textureFormatBlock accepts
+	uint32_t firstCopiedLevel = std::max(mip, texture.residentMip);
+	std::vector<vk::BufferImageCopy> uploads;
+	vk::DeviceSize stagingSize = 0;
+	for (uint32_t level = mip; level < firstCopiedLevel; ++level)
+	{
+		vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, level - mip, 0, 1);
+		vk::Extent3D levelExtent(std::max(1u, texture.width >> level), std::max(1u, texture.height >> level), 1);
+		uploads.push_back(vk::BufferImageCopy(stagingSize, 0, 0, subresource, vk::Offset3D(0, 0, 0), levelExtent));
+		stagingSize = (stagingSize + texture.levels[level].length + 15) & ~(vk::DeviceSize)15;
+	}
+
+	std::vector<vk::ImageCopy> copies;
+	for (uint32_t level = firstCopiedLevel; level < texture.levels.size(); ++level)
+	{
+		vk::ImageSubresourceLayers source(vk::ImageAspectFlagBits::eColor, level - texture.residentMip, 0, 1);
+		vk::ImageSubresourceLayers destination(vk::ImageAspectFlagBits::eColor, level - mip, 0, 1);
+		vk::Extent3D levelExtent(std::max(1u, texture.width >> level), std::max(1u, texture.height >> level), 1);
+		copies.push_back(vk::ImageCopy(source, vk::Offset3D(0, 0, 0), destination, vk::Offset3D(0, 0, 0), levelExtent));
+	}
+
+	if (stagingSize > 0)
+	{
+		texture.pendingStaging = createBuffer(stagingSize, vk::BufferUsageFlagBits::eTransferSrc,
+											  vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+		uint8_t* mapped = (uint8_t*)gDevice->mapMemory(texture.pendingStaging.memory.get(), 0, stagingSize);
+		for (uint32_t level = mip; level < firstCopiedLevel; ++level)
+		{
+			const Ktx2Level& source = texture.levels[level];
+			memcpy(mapped + uploads[level - mip].bufferOffset, texture.file.data + source.offset, (size_t)source.length);
+		}
+		gDevice->unmapMemory(texture.pendingStaging.memory.get());
+	}
+
+	texture.pendingCommands = std::move(gDevice->allocateCommandBuffersUnique(
+		vk::CommandBufferAllocateInfo(gCommandPool.get(), vk::CommandBufferLevel::ePrimary, 1))[0]);
+	vk::CommandBuffer cmd = texture.pendingCommands.get();
+	cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1);
+	vk::ImageMemoryBarrier toTransferDst(vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite,
+										 vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+										 VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+										 image.image.get(), range);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+						vk::DependencyFlags(), nullptr, nullptr, toTransferDst);
+
+	if (!copies.empty())
+	{
+		// the current image was filled by an earlier transfer, make it visible to this one
+		vk::ImageSubresourceRange residentRange(vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1);
+		vk::ImageMemoryBarrier toTransferRead(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead,
+											  vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral,
+											  VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+											  texture.image.image.get(), residentRange);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+							vk::DependencyFlags(), nullptr, nullptr, toTransferRead);
+
+		cmd.copyImage(texture.image.image.get(), vk::ImageLayout::eGeneral,
+					  image.image.get(), vk::ImageLayout::eTransferDstOptimal, copies);
+	}
+
+	if (!uploads.empty())
+	{
+		cmd.copyBufferToImage(texture.pendingStaging.buffer.get(), image.image.get(), vk::ImageLayout::eTransferDstOptimal, uploads);
+	}
+
+	vk::ImageMemoryBarrier toShaderRead(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead,
+										vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eGeneral,
+										VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+										image.image.get(), range);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+						vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader,
+						vk::DependencyFlags(), nullptr, nullptr, toShaderRead);
+	cmd.end();
+
+	texture.pendingFence = gDevice->createFenceUnique(vk::FenceCreateInfo());
+	vk::SubmitInfo submitInfo(0, nullptr, nullptr, 1, &cmd);
+	gGraphicsQueue.submit(1, &submitInfo, texture.pendingFence.get());
+
+	texture.pendingMip = mip;
+	texture.pendingBytes = gDevice->getImageMemoryRequirements(image.image.get()).size;
+	texture.pendingImage = std::move(image);
+	gTextureResidentBytes += texture.pendingBytes;
+
+	return stagingSize;
+}
+
+// swap in the image of a residency change that finished on the GPU
+static void finishTextureResidency(StreamedTexture& texture)
+{
+	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, (uint32_t)texture.levels.size() - texture.pendingMip, 0, 1);
+	vk::ImageViewCreateInfo viewInfo(vk::ImageViewCreateFlags(),
+									 texture.pendingImage.image.get(),
+									 vk::ImageViewType::e2D,
+									 texture.format,
+									 vk::ComponentMapping(),
+									 range);
+	vk::UniqueImageView view = gDevice->createImageViewUnique(viewInfo);
+
+	// frames already recorded may still sample the previous image, it counts against the budget until freed
+	if (texture.image.image)
+	{
+		gRetiredTextures.push_back(RetiredTexture{ gFrameNumber, std::move(texture.image), std::move(texture.view), texture.residentBytes });
+	}
+
+	texture.image = std::move(texture.pendingImage);
+	texture.view = std::move(view);
+	texture.residentMip = texture.pendingMip;
+	texture.residentBytes = texture.pendingBytes;
+	texture.pendingBytes = 0;
+	texture.pendingStaging = AllocatedBuffer();
+	texture.pendingCommands.reset();
+	texture.pendingFence.reset();
+}
+
+// texel block of the formats the streamer can upload, false for any other format.
+// every block is a power of two of at most 16 bytes, so the 16 byte staging offsets are valid for all of them
+static bool textureFormatBlock(uint32_t format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes)
+{
+	blockWidth = 1;
+	blockHeight = 1;
+	switch (format)
+	{
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_SNORM:
+	case VK_FORMAT_R8_UINT:
+	case VK_FORMAT_R8_SINT:
+	case VK_FORMAT_R8_SRGB:
+		blockBytes = 1;
+		return true;
+	case VK_FORMAT_R5G6B5_UNORM_PACK16:
+	case VK_FORMAT_B5G6R5_UNORM_PACK16:
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SNORM:
+	case VK_FORMAT_R8G8_UINT:
+	case VK_FORMAT_R8G8_SINT:
+	case VK_FORMAT_R8G8_SRGB:
+	case VK_FORMAT_R16_UNORM:
+	case VK_FORMAT_R16_SNORM:
+	case VK_FORMAT_R16_UINT:
+	case VK_FORMAT_R16_SINT:
+	case VK_FORMAT_R16_SFLOAT:
+		blockBytes = 2;
+		return true;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SNORM:
+	case VK_FORMAT_R8G8B8A8_UINT:
+	case VK_FORMAT_R8G8B8A8_SINT:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+	case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+	case VK_FORMAT_R16G16_UNORM:
+	case VK_FORMAT_R16G16_SNORM:
+	case VK_FORMAT_R16G16_UINT:
+	case VK_FORMAT_R16G16_SINT:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_UINT:
+	case VK_FORMAT_R32_SINT:
+	case VK_FORMAT_R32_SFLOAT:
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+		blockBytes = 4;
+		return true;
+	case VK_FORMAT_R16G16B16A16_UNORM:
+	case VK_FORMAT_R16G16B16A16_SNORM:
+	case VK_FORMAT_R16G16B16A16_UINT:
+	case VK_FORMAT_R16G16B16A16_SINT:
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	case VK_FORMAT_R32G32_UINT:
+	case VK_FORMAT_R32G32_SINT:
+	case VK_FORMAT_R32G32_SFLOAT:
+		blockBytes = 8;
+		return true;
+	case VK_FORMAT_R32G32B32A32_UINT:
+	case VK_FORMAT_R32G32B32A32_SINT:
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		blockBytes = 16;
+		return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		blockWidth = 4;
+		blockHeight = 4;
+		blockBytes = 8;
+		return true;
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+		blockWidth = 4;
+		blockHeight = 4;
+		blockBytes = 16;
+		return true;
+	}
+
+	// ASTC blocks are always 16 bytes, the footprint follows from the position in the enum
+	static const uint8_t astcFootprints[14][2] = {
+		{ 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+		{ 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+	};
+	if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+	{
+		// UNORM and SRGB alternate for each footprint
+		uint32_t footprint = (format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+		blockWidth = astcFootprints[footprint][0];
+		blockHeight = astcFootprints[footprint][1];
+		blockBytes = 16;
+		return true;
+	}
+
+	return false;
+}
+
+StreamedTexture* loadTexture(const std::string& filename)
+{
+	struct Ktx2Header
+	{
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+	static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be tightly packed");
+
+	static const uint8_t ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	auto texture = std::unique_ptr<StreamedTexture>(new StreamedTexture(filename));
+	const uint8_t* data = texture->file.data;
+	size_t size = texture->file.size;
+
+	Ktx2Header header;
+	if (size < sizeof(header))
+	{
+		throw std::runtime_error("invalid KTX2 file!");
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.identifier, ktx2Identifier, sizeof(ktx2Identifier)) != 0)
+	{
+		throw std::runtime_error("invalid KTX2 file!");
+	}
+
+	// Basis Universal and Zstd payloads need a transcoder, only GPU ready formats are streamed
+	if (header.supercompressionScheme != 0 || header.vkFormat == VK_FORMAT_UNDEFINED)
+	{
+		throw std::runtime_error("supercompressed KTX2 files are not supported, transcode them offline!");
+	}
+
+	if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+	{
+		throw std::runtime_error("only single 2D KTX2 textures are supported!");
+	}
+
+	uint32_t blockWidth, blockHeight, blockBytes;
+	if (!textureFormatBlock(header.vkFormat, blockWidth, blockHeight, blockBytes))
+	{
+		throw std::runtime_error("KTX2 texture format is not supported!");
+	}
+
+	uint32_t maxDimension = gSelectedPhysicalDevice.getProperties().limits.maxImageDimension2D;
+	if (header.pixelWidth > maxDimension || header.pixelHeight > maxDimension)
+	{
+		throw std::runtime_error("KTX2 texture is larger than the GPU supports!");
+	}
+
+	// the levels are read without robustBufferAccess, every one has to be exactly the size its extent needs
+	uint32_t levelCount = std::max(1u, header.levelCount);
+	uint32_t fullMipCount = 1;
+	while ((std::max(header.pixelWidth, header.pixelHeight) >> fullMipCount) > 0)
+	{
+		++fullMipCount;
+	}
+	if (levelCount > fullMipCount || size < sizeof(header) + levelCount * sizeof(uint64_t) * 3)
+	{
+		throw std::runtime_error("invalid KTX2 file!");
+	}
+
+	const uint8_t* levelIndex = data + sizeof(header);
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		Ktx2Level entry;
+		memcpy(&entry.offset, levelIndex + level * sizeof(uint64_t) * 3, sizeof(uint64_t));
+		memcpy(&entry.length, levelIndex + level * sizeof(uint64_t) * 3 + sizeof(uint64_t), sizeof(uint64_t));
+
+		uint64_t blocksWide = (std::max(1u, header.pixelWidth >> level) + blockWidth - 1) / blockWidth;
+		uint64_t blocksHigh = (std::max(1u, header.pixelHeight >> level) + blockHeight - 1) / blockHeight;
+		if (entry.length != blocksWide * blocksHigh * blockBytes || entry.offset > size || entry.length > size - entry.offset)
+		{
+			throw std::runtime_error("invalid KTX2 file!");
+		}
+		texture->levels.push_back(entry);
+	}
+
+	texture->format = (vk::Format)header.vkFormat;
+	texture->width = header.pixelWidth;
+	texture->height = header.pixelHeight;
+
+	if (!(gSelectedPhysicalDevice.getFormatProperties(texture->format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage))
+	{
+		throw std::runtime_error("KTX2 texture format is not supported by the GPU!");
+	}
+
+	texture->tailMip = levelCount - 1;
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		if (std::max(texture->width >> level, texture->height >> level) <= gTextureTailSize)
+		{
+			texture->tailMip = level;
+			break;
+		}
+	}
+
+	texture->residentMip = levelCount;
+	texture->requestedMip = texture->tailMip;
+	texture->lastUsedFrame = gFrameNumber;
+	beginTextureResidency(*texture, texture->tailMip);
+
+	gTextures.push_back(std::move(texture));
+	return gTextures.back().get();
+}
+
+void requestTextureMip(StreamedTexture* texture, uint32_t mip)
+{
+	texture->requestedMip = std::min(mip, texture->tailMip);
+	texture->lastUsedFrame = gFrameNumber;
+}
+
+void updateTextureStreaming()
+{
+	for (auto retired = gRetiredTextures.begin(); retired != gRetiredTextures.end();)
+	{
+		if (retired->frame + gSwapChainImages.size() < gFrameNumber)
+		{
+			gTextureResidentBytes -= retired->bytes;
+			retired = gRetiredTextures.erase(retired);
+		}
+		else
+		{
+			++retired;
+		}
+	}
+
+	for (auto& texture : gTextures)
+	{
+		if (texture->pendingFence && gDevice->getFenceStatus(texture->pendingFence.get()) == vk::Result::eSuccess)
+		{
+			finishTextureResidency(*texture);
+		}
+	}
+
+	vk::DeviceSize budget = queryTextureBudget();
+	if (gTextureBudgetOverride > 0)
+	{
+		budget = std::min(budget, gTextureBudgetOverride);
+	}
+
+	// retired images and the ones with a replacement on the way are as good as gone,
+	// evicting more to cover them would overshoot
+	auto projectedResidentBytes = []() -> vk::DeviceSize
+	{
+		vk::DeviceSize bytes = gTextureResidentBytes;
+		for (const auto& retired : gRetiredTextures)
+		{
+			bytes -= retired.bytes;
+		}
+		for (auto& texture : gTextures)
+		{
+			if (texture->pendingFence)
+			{
+				bytes -= texture->residentBytes;
+			}
+		}
+		return bytes;
+	};
+
+	// drop the least recently used texture that is not needed this frame back to its mip tail
+	static uint64_t evictions = 0;
+	auto evictLeastRecentlyUsed = []() -> bool
+	{
+		StreamedTexture* victim = nullptr;
+		for (auto& texture : gTextures)
+		{
+			if (!texture->pendingFence && texture->residentMip < texture->tailMip && texture->lastUsedFrame < gFrameNumber &&
+				(!victim || texture->lastUsedFrame < victim->lastUsedFrame))
+			{
+				victim = texture.get();
+			}
+		}
+
+		if (!victim)
+		{
+			return false;
+		}
+
+		beginTextureResidency(*victim, victim->tailMip);
+		++evictions;
+		return true;
+	};
+
+	while (projectedResidentBytes() > budget && evictLeastRecentlyUsed())
+	{
+	}
+
+	// stream in one more detailed level per requested texture, capped per frame so uploads don't stall it.
+	// the new image exists next to the old one until the old one is freed, so both have to fit
+	vk::DeviceSize uploadedBytes = 0;
+	for (auto& texture : gTextures)
+	{
+		if (uploadedBytes >= gTextureUploadBytesPerFrame)
+		{
+			break;
+		}
+
+		if (texture->pendingFence || texture->lastUsedFrame != gFrameNumber || texture->requestedMip >= texture->residentMip)
+		{
+			continue;
+		}
+
+		uint32_t mip = texture->residentMip - 1;
+		vk::DeviceSize extraBytes = textureLevelBytes(*texture, mip);
+		while (projectedResidentBytes() + extraBytes > budget && evictLeastRecentlyUsed())
+		{
+		}
+
+		if (gTextureResidentBytes + extraBytes > budget)
+		{
+			continue;
+		}
+
+		uploadedBytes += beginTextureResidency(*texture, mip);
+	}
+
+	// report residency once a second
+	static uint32_t lastReport = SDL_GetTicks();
+	static vk::DeviceSize reportUploaded = 0;
+	reportUploaded += uploadedBytes;
+	if (!gTextures.empty() && SDL_GetTicks() - lastReport >= 1000)
+	{
+		std::cout << "textures: " << gTextureResidentBytes / (1024 * 1024) << " of " << budget / (1024 * 1024)
+			<< " MiB budget resident, " << reportUploaded / (1024 * 1024) << " MiB uploaded, " << evictions << " evictions\n";
+		lastReport = SDL_GetTicks();
+		reportUploaded = 0;
+		evictions = 0;
+	}
+}
+
+static MeshData loadMesh(const std::string& filename)
+{
+	std::vector<char> file = readFile(filename);
+	size_t offset = 0;
+
+	auto read = [&](void* destination, size_t size)
+	{
+		if (size > file.size() - offset)
+		{
+			throw std::runtime_error("invalid mesh file!");
+		}
+		if (size > 0)
+		{
+			memcpy(destination, file.data() + offset, size);
+		}
+		offset += size;
+	};
+
+	MeshFileHeader header;
+	read(&header, sizeof(header));
+	if (memcmp(header.magic, "MSH2", 4) != 0 || header.lodCount == 0)
+	{
+		throw std::runtime_error("invalid mesh file!");
+	}
+
+	// check the counts against the file before allocating anything for them
+	uint64_t payloadSize = (uint64_t)header.lodCount * sizeof(MeshLod) + (uint64_t)header.vertexCount * sizeof(MeshVertex) +
+		(uint64_t)header.indexCount * sizeof(uint32_t) + (uint64_t)header.meshletCount * sizeof(Meshlet) +
+		(uint64_t)header.meshletVertexCount * sizeof(uint32_t) + (uint64_t)header.indexCount * sizeof(uint8_t);
+	if (payloadSize != file.size() - offset)
+	{
+		throw std::runtime_error("invalid mesh file!");
+	}
+
+	MeshData mesh;
+	mesh.center = header.center;
+	mesh.radius = header.radius;
+	mesh.lods.resize(header.lodCount);
+	mesh.vertices.resize(header.vertexCount);
+	mesh.indices.resize(header.indexCount);
+	mesh.meshlets.resize(header.meshletCount);
+	mesh.meshletVertices.resize(header.meshletVertexCount);
+	mesh.meshletIndices.resize(header.indexCount);
+	read(mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+	read(mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex));
+	read(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	read(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+	read(mesh.meshletVertices.data(), mesh.meshletVertices.size() * sizeof(uint32_t));
+	read(mesh.meshletIndices.data(), mesh.meshletIndices.size() * sizeof(uint8_t));
+
+	// every index and meshlet ends up in GPU buffers read without robustBufferAccess, so nothing may point outside its LOD
+	for (const auto& lod : mesh.lods)
+	{
+		if ((uint64_t)lod.vertexOffset + lod.vertexCount > mesh.vertices.size() ||
+			(uint64_t)lod.indexOffset + lod.indexCount > mesh.indices.size() ||
+			(uint64_t)lod.meshletOffset + lod.meshletCount > mesh.meshlets.size() ||
+			lod.indexCount % 3 != 0)
+		{
+			throw std::runtime_error("invalid mesh file!");
+		}
+
+		for (uint32_t i = 0; i < lod.indexCount; ++i)
+		{
+			if (mesh.indices[lod.indexOffset + i] >= lod.vertexCount)
+			{
+				throw std::runtime_error("invalid mesh file!");
+			}
+		}
+
+		for (uint32_t i = 0; i < lod.meshletCount; ++i)
+		{
+			const Meshlet& meshlet = mesh.meshlets[lod.meshletOffset + i];
+			if ((uint64_t)meshlet.indexOffset + (uint64_t)meshlet.triangleCount * 3 > lod.indexCount ||
+				(uint64_t)meshlet.vertexOffset + meshlet.vertexCount > mesh.meshletVertices.size() ||
+				meshlet.triangleCount > gMeshletMaxTriangles || meshlet.vertexCount > gMeshletMaxVertices)
+			{
+				throw std::runtime_error("invalid mesh file!");
+			}
+
+			for (uint32_t j = 0; j < meshlet.vertexCount; ++j)
+			{
+				if (mesh.meshletVertices[meshlet.vertexOffset + j] >= lod.vertexCount)
+				{
+					throw std::runtime_error("invalid mesh file!");
+				}
+			}
+
+			// local indices have to land on the same vertex as the LOD's indices
+			for (uint32_t j = 0; j < meshlet.triangleCount * 3; ++j)
+			{
+				uint32_t index = lod.indexOffset + meshlet.indexOffset + j;
+				uint8_t local = mesh.meshletIndices[index];
+				if (local >= meshlet.vertexCount || mesh.meshletVertices[meshlet.vertexOffset + local] != mesh.indices[index])
+				{
+					throw std::runtime_error("invalid mesh file!");
+				}
+			}
+		}
+	}
+
+	return mesh;
+}
+
+static AllocatedBuffer createDeviceLocalBuffer(const void* data, vk::DeviceSize size, vk::BufferUsageFlags usage)
+{
+	AllocatedBuffer staging = createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+										   vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	void* mapped = gDevice->mapMemory(staging.memory.get(), 0, size);
+	memcpy(mapped, data, (size_t)size);
+	gDevice->unmapMemory(staging.memory.get());
+
+	AllocatedBuffer buffer = createBuffer(size, usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	submitImmediate([&](vk::CommandBuffer cmd)
+	{
+		cmd.copyBuffer(staging.buffer.get(), buffer.buffer.get(), vk::BufferCopy(0, 0, size));
+	});
+
+	return buffer;
+}
+
+void createMeshResources()
+{
+	if (gMeshFiles.empty())
+	{
+		return;
+	}
+
+	// all meshes share one vertex and one index buffer
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	float maxRadius = 0.0f;
+	for (const auto& filename : gMeshFiles)
+	{
+		LoadedMesh mesh;
+		mesh.data = loadMesh(filename);
+		mesh.baseVertex = (uint32_t)vertices.size();
+		mesh.baseIndex = (uint32_t)indices.size();
+		vertices.insert(vertices.end(), mesh.data.vertices.begin(), mesh.data.vertices.end());
+		indices.insert(indices.end(), mesh.data.indices.begin(), mesh.data.indices.end());
+		maxRadius = std::max(maxRadius, mesh.data.radius);
+		gMeshes.push_back(std::move(mesh));
+	}
+
+	gMeshVertexBuffer = createDeviceLocalBuffer(vertices.data(), vertices.size() * sizeof(MeshVertex), vk::BufferUsageFlagBits::eVertexBuffer);
+	gMeshIndexBuffer = createDeviceLocalBuffer(indices.data(), indices.size() * sizeof(uint32_t), vk::BufferUsageFlagBits::eIndexBuffer);
+
+	// lay gMeshGridSize x gMeshGridSize copies of every mesh out on a grid centered on the origin
+	uint32_t side = (uint32_t)std::ceil(std::sqrt((float)(gMeshes.size() * gMeshGridSize * gMeshGridSize)));
+	float spacing = maxRadius * 3.0f;
+	for (uint32_t i = 0; i < gMeshes.size() * gMeshGridSize * gMeshGridSize; ++i)
+	{
+		MeshObject object;
+		object.mesh = i % (uint32_t)gMeshes.size();
+		glm::vec3 gridPoint((i % side - (side - 1) * 0.5f) * spacing, 0.0f, (i / side - (side - 1) * 0.5f) * spacing);
+		object.position = gridPoint - gMeshes[object.mesh].data.center;
+		gMeshObjects.push_back(object);
+	}
+	gMeshSceneRadius = side * spacing * 0.75f;
+
+	// per swap chain image, persistently mapped
+	uint32_t frameCount = (uint32_t)gSwapChainImages.size();
+	vk::DescriptorPoolSize poolSize(vk::DescriptorType::eStorageBuffer, frameCount);
+	gMeshDescriptorPool = gDevice->createDescriptorPoolUnique(
+		vk::DescriptorPoolCreateInfo(vk::DescriptorPoolCreateFlags(), frameCount, 1, &poolSize));
+
+	std::vector<vk::DescriptorSetLayout> setLayouts(frameCount, gMeshSetLayout.get());
+	std::vector<vk::DescriptorSet> sets = gDevice->allocateDescriptorSets(
+		vk::DescriptorSetAllocateInfo(gMeshDescriptorPool.get(), frameCount, setLayouts.data()));
+
+	gMeshFrames.resize(frameCount);
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		MeshFrameResources& frame = gMeshFrames[i];
+		vk::DeviceSize objectsSize = (gMeshObjects.size() + 1) * sizeof(glm::mat4);
+		vk::DeviceSize drawCommandsSize = gMeshObjects.size() * sizeof(vk::DrawIndexedIndirectCommand);
+		vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+		frame.objects = createBuffer(objectsSize, vk::BufferUsageFlagBits::eStorageBuffer, hostVisible);
+		frame.drawCommands = createBuffer(drawCommandsSize, vk::BufferUsageFlagBits::eIndirectBuffer, hostVisible);
+		frame.objectData = (glm::mat4*)gDevice->mapMemory(frame.objects.memory.get(), 0, objectsSize);
+		frame.drawCommandData = (vk::DrawIndexedIndirectCommand*)gDevice->mapMemory(frame.drawCommands.memory.get(), 0, drawCommandsSize);
+		frame.set = sets[i];
+
+		vk::DescriptorBufferInfo bufferInfo(frame.objects.buffer.get(), 0, VK_WHOLE_SIZE);
+		gDevice->updateDescriptorSets(vk::WriteDescriptorSet(frame.set, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo), nullptr);
+
+		// nothing is drawn until the first update
+		memset(frame.drawCommandData, 0, (size_t)drawCommandsSize);
+	}
+}
+
+void updateMeshDraws(uint32_t frameIndex)
+{
+	if (gMeshObjects.empty())
+	{
+		return;
+	}
+
+	// orbit the grid while moving in and out, so objects keep crossing LOD switches
+	float time = SDL_GetTicks() * 0.001f;
+	float distance = gMeshSceneRadius * (1.25f + std::sin(time * 0.25f));
+	glm::vec3 eye(std::cos(time * 0.2f) * distance, distance * 0.35f, std::sin(time * 0.2f) * distance);
+	float nearPlane = gMeshSceneRadius * 0.001f;
+
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projection = glm::perspective(gCameraFov, (float)gSwapChainExtent.width / gSwapChainExtent.height, nearPlane, gMeshSceneRadius * 10.0f);
+	projection[1][1] *= -1.0f; // vulkan clip space y points down
+
+	MeshFrameResources& frame = gMeshFrames[frameIndex];
+	frame.objectData[0] = projection * view;
+
+	// pick the coarsest LOD whose error, projected at the object's nearest point, stays under gLodErrorPixels
+	float pixelsPerUnit = gSwapChainExtent.height / (2.0f * std::tan(gCameraFov * 0.5f));
+	uint64_t trianglesSubmitted = 0;
+	uint64_t trianglesFull = 0;
+	for (size_t i = 0; i < gMeshObjects.size(); ++i)
+	{
+		const MeshObject& object = gMeshObjects[i];
+		const LoadedMesh& mesh = gMeshes[object.mesh];
+		float objectDistance = std::max(glm::length(object.position + mesh.data.center - eye) - mesh.data.radius, nearPlane);
+
+		size_t lod = 0;
+		while (lod + 1 < mesh.data.lods.size() &&
+			   mesh.data.lods[lod + 1].error / objectDistance * pixelsPerUnit <= gLodErrorPixels)
+		{
+			++lod;
+		}
+
+		const MeshLod& selected = mesh.data.lods[lod];
+		frame.objectData[i + 1] = glm::translate(glm::mat4(1.0f), object.position);
+		frame.drawCommandData[i] = vk::DrawIndexedIndirectCommand(selected.indexCount, 1,
+																   mesh.baseIndex + selected.indexOffset,
+																   (int32_t)(mesh.baseVertex + selected.vertexOffset), 0);
+
+		trianglesSubmitted += selected.indexCount / 3;
+		trianglesFull += mesh.data.lods[0].indexCount / 3;
+	}
+
+	// report the per frame average once a second
+	static uint32_t lastReport = SDL_GetTicks();
+	static uint64_t reportFrames = 0;
+	static uint64_t reportSubmitted = 0;
+	static uint64_t reportFull = 0;
+	++reportFrames;
+	reportSubmitted += trianglesSubmitted;
+	reportFull += trianglesFull;
+	if (SDL_GetTicks() - lastReport >= 1000)
+	{
+		std::cout << "triangles per frame: " << reportSubmitted / reportFrames << " with LOD selection, "
+			<< reportFull / reportFrames << " at full detail\n";
+		lastReport = SDL_GetTicks();
+		reportFrames = 0;
+		reportSubmitted = 0;
+		reportFull = 0;
+	}
+}
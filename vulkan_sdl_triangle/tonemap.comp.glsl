@@ -0,0 +1,46 @@
+#version 450
+
+#define GROUP_SIZE 16
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+layout(binding = 0, rgba16f) uniform readonly image2D hdrImage;
+layout(binding = 1, rgba8) uniform writeonly image2D ldrImage;
+layout(binding = 2) uniform sampler2D bloomTexture;
+layout(binding = 4) readonly buffer Exposure {
+    float averageLuminance;
+    float exposure;
+} exposure;
+
+layout(push_constant) uniform PushConstants {
+    float bloomStrength;
+    uint encodeSrgb;
+} pc;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 tonemapACES(vec3 x) {
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec3 linearToSrgb(vec3 color) {
+    return mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, color));
+}
+
+void main() {
+    ivec2 size = imageSize(hdrImage);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= size.x || pixel.y >= size.y) {
+        return;
+    }
+
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+    vec3 color = imageLoad(hdrImage, pixel).rgb;
+    color += textureLod(bloomTexture, uv, 0.0).rgb * pc.bloomStrength;
+    color = tonemapACES(color * exposure.exposure);
+
+    // UNORM swap chains need the sRGB encode here, *_SRGB ones get it from the blit into them
+    if (pc.encodeSrgb != 0u) {
+        color = linearToSrgb(color);
+    }
+    imageStore(ldrImage, pixel, vec4(color, 1.0));
+}